@@ -1603,6 +1603,8 @@ phase=x
 #
 if ac_ifcpp 'ifdef MKSH_SMALL' isset_MKSH_SMALL '' \
     "if a reduced-feature mksh is requested"; then
+	: ${HAVE_COPY_FILE_RANGE=0} ${HAVE_SENDFILE=0} ${HAVE_SPLICE=0}
+	: ${HAVE_DLOPEN=0} ${HAVE_DLOPEN_LDL=0}
 	: ${HAVE_NICE=0}
 	: ${HAVE_PERSISTENT_HISTORY=0}
 	check_categories="$check_categories smksh"
@@ -1652,6 +1654,7 @@ ac_header sys/mman.h sys/types.h
 ac_header sys/param.h
 ac_header sys/resource.h sys/types.h _time
 ac_header sys/select.h sys/types.h
+ac_header sys/sendfile.h sys/types.h
 ac_header sys/sysmacros.h
 ac_header bstring.h
 ac_header grp.h sys/types.h
@@ -1728,6 +1731,13 @@ ac_test rlim_t <<-'EOF'
 	int main(void) { return (((int)(rlim_t)0) + isatty(0)); }
 EOF
 
+ac_test st_blksize '' 'for the st_blksize member of struct stat' <<-'EOF'
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	int main(void) { struct stat sb; return (fstat(0, &sb) ? 0 :
+	    (int)sb.st_blksize); }
+EOF
+
 # only testn: added later below
 ac_testn sig_t <<-'EOF'
 	#include <sys/types.h>
@@ -1856,6 +1866,37 @@ done
 #
 # Environment: library functions
 #
+ac_testn dlopen '' 'for dlopen and dlsym' <<-'EOF'
+	#include <dlfcn.h>
+	#include <stddef.h>
+	int main(void) { void *h = dlopen(NULL, RTLD_NOW);
+	    return (h == NULL || dlsym(h, "dlopen") == NULL); }
+EOF
+if test 0 = "$HAVE_DLOPEN"; then
+	save_LIBS=$LIBS
+	LIBS="$LIBS -ldl"
+	ac_testn dlopen_ldl '' 'for dlopen and dlsym in -ldl' <<-'EOF'
+		#include <dlfcn.h>
+		#include <stddef.h>
+		int main(void) { void *h = dlopen(NULL, RTLD_NOW);
+		    return (h == NULL || dlsym(h, "dlopen") == NULL); }
+	EOF
+	if test 1 = "$HAVE_DLOPEN_LDL"; then
+		HAVE_DLOPEN=1
+	else
+		LIBS=$save_LIBS
+	fi
+fi
+ac_cppflags DLOPEN
+
+ac_test copy_file_range <<-'EOF'
+	#include <sys/types.h>
+	#include <stddef.h>
+	#include <unistd.h>
+	int main(void) { return ((int)copy_file_range(0, NULL, 1, NULL,
+	    (size_t)1, 0U)); }
+EOF
+
 ac_test flock <<-'EOF'
 	#include <sys/types.h>
 	#include <fcntl.h>
@@ -1945,6 +1986,15 @@ ac_test nice <<-'EOF'
 	int main(void) { return (nice(4)); }
 EOF
 
+ac_test openat '' 'for openat and fdopendir' <<-'EOF'
+	#include <sys/types.h>
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <stddef.h>
+	int main(void) { return (fdopendir(openat(AT_FDCWD, ".",
+	    O_RDONLY | O_DIRECTORY | O_NOFOLLOW)) == NULL); }
+EOF
+
 ac_test revoke <<-'EOF'
 	#include <sys/types.h>
 	#if HAVE_LIBUTIL_H
@@ -1999,6 +2049,13 @@ ac_test select <<-'EOF'
 	}
 EOF
 
+ac_test sendfile sys_sendfile_h 0 <<-'EOF'
+	#include <sys/types.h>
+	#include <sys/sendfile.h>
+	#include <stddef.h>
+	int main(void) { return ((int)sendfile(1, 0, NULL, (size_t)1)); }
+EOF
+
 ac_test setresugid <<-'EOF'
 	#include <sys/types.h>
 	#include <unistd.h>
@@ -2057,12 +2114,33 @@ ac_test strsignal '!' sys_siglist 0 <<-'EOF'
 	int main(void) { return (strsignal(1)[0]); }
 EOF
 
+ac_test signalfd <<-'EOF'
+	#include <signal.h>
+	#include <sys/signalfd.h>
+	int main(void) { sigset_t s; sigemptyset(&s);
+	    return (signalfd(-1, &s, SFD_CLOEXEC)); }
+EOF
+
+ac_test splice <<-'EOF'
+	#include <sys/types.h>
+	#include <fcntl.h>
+	#include <stddef.h>
+	int main(void) { return ((int)splice(0, NULL, 1, NULL, (size_t)1,
+	    SPLICE_F_MOVE)); }
+EOF
+
 ac_test strlcpy <<-'EOF'
 	#include <string.h>
 	int main(int ac, char *av[]) { return (strlcpy(*av, av[1],
 	    (size_t)ac)); }
 EOF
 
+ac_test vfork <<-'EOF'
+	#include <sys/types.h>
+	#include <unistd.h>
+	int main(void) { return ((int)vfork()); }
+EOF
+
 #
 # check headers for declarations
 #
@@ -2297,8 +2375,25 @@ mksh_cfg= NSIG
 fi
 
 addsrcs '!' HAVE_STRLCPY strlcpy.c
+: ${USE_PRINTF_BUILTIN=1}
 addsrcs USE_PRINTF_BUILTIN printf.c
 test 1 = "$USE_PRINTF_BUILTIN" && add_cppflags -DMKSH_PRINTF_BUILTIN
+: ${USE_TEXT_BUILTINS=head tail tr wc}
+for i in $USE_TEXT_BUILTINS; do
+	case $i in
+	head|tail|tr|wc)
+		add_cppflags -DMKSH_`upper $i`_BUILTIN
+		case " $SRCS " in
+		*\ textutil.c\ *)	;;
+		*)		SRCS="$SRCS textutil.c"
+				add_cppflags -DMKSH_TEXT_BUILTINS ;;
+		esac
+		;;
+	*)
+		echo "$me: Unknown text builtin '$i' ignored!" >&2
+		;;
+	esac
+done
 test 1 = "$HAVE_CAN_VERB" && CFLAGS="$CFLAGS -verbose"
 add_cppflags -DMKSH_BUILD_R=491
 
@@ -2580,7 +2675,9 @@ TARGET_OS			default: $(uname -s || uname)
 TARGET_OSREV			[QNX] default: $(uname -r)
 
 ==== feature selectors ====
-USE_PRINTF_BUILTIN		1 to include (unsupported) printf(1) as builtin
+USE_PRINTF_BUILTIN		0 to omit the printf(1) builtin (default: 1)
+USE_TEXT_BUILTINS		which of the head(1), tail(1), tr(1), wc(1)
+				builtins to include (default: all of them)
 ===== general format =====
 HAVE_STRLEN			ac_test
 HAVE_STRING_H			ac_header
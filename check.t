@@ -2148,6 +2148,31 @@ expected-stdout:
 	before='#foo'
 	after =''
 ---
+name: globstar-1
+description:
+	Check that ** matches zero or more directories, but does
+	not descend into dot directories or symbolic links
+stdin:
+	mkdir -p a/b/c .h
+	:>top.c; :>a/x.c; :>a/b/y.c; :>a/b/c/z.c; :>.h/q.c
+	ln -s ../a a/b/loop
+	echo **/*.c
+	set -o globstar
+	echo **/*.c
+	echo a/**/z.c a/**/nonexistent
+	echo a/**
+	:>a/.e.c
+	echo **/.*.c **/[bc]/*.c
+	set -X
+	echo **/c
+expected-stdout:
+	a/x.c
+	a/b/c/z.c a/b/y.c a/x.c top.c
+	a/b/c/z.c a/**/nonexistent
+	a/b a/b/c a/b/c/z.c a/b/loop a/b/y.c a/x.c
+	a/.e.c a/b/c/z.c a/b/y.c
+	a/b/c/
+---
 name: heredoc-1
 description:
 	Check ordering/content of redundent here documents.
@@ -5593,6 +5618,147 @@ expected-stdout:
 	y1-
 	x2-3- z1-
 ---
+name: exec-pathcache-1
+description:
+	Check that commands are found right after they are installed
+	in, and not after they are removed from, a cached PATH directory,
+	and that tracked aliases are checked even if the name is listed
+stdin:
+	mkdir d e
+	print 'echo run old' >d/cmd-old
+	print 'echo run next' >e/cmd-old
+	chmod +x d/cmd-old e/cmd-old
+	PATH=$PWD/d:$PWD/e:$PATH
+	for i in 1 2 3 4 5 6 7 8 9 10; do
+		whence -p cmd-new || n=$i
+		: >d/other$i
+	done
+	echo no $n
+	print 'echo run new' >d/cmd-new
+	chmod +x d/cmd-new
+	cmd-new
+	rm d/cmd-new
+	cmd-new 2>/dev/null || echo gone
+	cmd-old
+	chmod -x d/cmd-old
+	cmd-old
+expected-stdout:
+	no 10
+	run new
+	gone
+	run old
+	run next
+---
+name: exec-hashfile-1
+description:
+	Check that commands found by several shells end up in HASHFILE
+category: !smksh
+stdin:
+	mkdir d
+	for x in foo bar; do
+		print "echo $x ran" >d/$x
+		chmod +x d/$x
+	done
+	touch -t 200001010000 d
+	"$__progname" -c 'HASHFILE=$PWD/hc PATH=$PWD/d; foo; :'
+	"$__progname" -c 'HASHFILE=$PWD/hc PATH=$PWD/d; bar; foo; :'
+	tr '\0' '\n' <hc | grep "^$PWD/d/" | sed "s!^$PWD/d/!!"
+expected-stdout:
+	foo ran
+	bar ran
+	foo ran
+	bar
+	foo
+---
+name: builtin-load-1
+description:
+	Check that failing to load builtins leaves them undefined
+stdin:
+	builtin -f ./nonexistent.so foo 2>/dev/null; echo $?
+	foo 2>/dev/null; echo $?
+	builtin -f 2>/dev/null; echo $?
+	builtin -f./nonexistent.so foo 2>/dev/null; echo $?
+	builtin -x 2>/dev/null; echo $?
+expected-stdout:
+	1
+	127
+	1
+	1
+	1
+---
+name: exec-signals-1
+description:
+	Check that external commands get ignored signals ignored and
+	trapped ones reset, and that scripts without #! still run
+stdin:
+	print 'kill -2 $$; echo survived' >x1
+	print 'echo no-shebang $#' >x3
+	chmod +x x1 x3
+	trap 'echo trap' 2
+	"$__progname" x1
+	echo rv=$?
+	trap '' 2
+	"$__progname" x1
+	echo rv=$?
+	./x3 a b
+expected-stdout:
+	rv=130
+	survived
+	rv=0
+	no-shebang 2
+---
+name: wait-next-1
+description:
+	Check that wait -n returns the status of the job finishing first
+	and that JOBMAX limits the number of running background jobs
+stdin:
+	sleep 2 & (sleep 0.2; exit 3) &
+	wait -n -p pid; echo rv=$? ${pid:+pid}
+	wait -n; echo rv=$?
+	wait -n; echo rv=$?
+	JOBMAX=2
+	for i in 1 2 3 4 5; do
+		sleep 0.2 &
+		n=$(jobs | wc -l)
+		[[ $n -gt 2 ]] && echo too many: $n
+	done
+	wait
+	unset JOBMAX
+	echo $JOBMAX.
+expected-stdout:
+	rv=3 pid
+	rv=0
+	rv=127
+	.
+---
+name: for-parallel-1
+description:
+	Check the parallel for loop: statuses, ordered output and
+	reproducing it with typeset -f
+stdin:
+	f() {
+		for -P 3 -o -s st x in 3 1 2 0; do
+			sleep 0.$x
+			echo $x
+			exit $x
+		done
+	}
+	f; echo rv=$? ${st[*]}
+	typeset -f f | sed -n 2p
+	for -s st x; do :; done; echo rv=$? ${#st[*]}
+	x=$(for -P 2 -o i in a b; do print -n $i; done); echo $x
+	for -oP2 -sst i in 1 0; do exit $i; done; echo ${st[*]}
+expected-stdout:
+	3
+	1
+	2
+	0
+	rv=0 3 1 2 0
+		for -P 3 -o -s st x in 3 1 2 0 
+	rv=0 0
+	ab
+	1 0
+---
 name: xxx-what-do-you-call-this-1
 stdin:
 	echo "${foo:-"a"}*"
@@ -6488,6 +6654,30 @@ expected-stdout:
 	7 42 .
 	8 0 .
 ---
+name: pipeline-5
+description:
+	Check that "set -o lastpipe" runs the last command in the shell
+stdin:
+	n=0; echo a | read n; echo 1 $n .
+	set -o lastpipe
+	printf '%s\n' a b c | while read x; do n=$((n+1)); done
+	echo 2 $n .
+	(exit 12) | { read n; (exit 3); }
+	echo 3 $? $n , ${PIPESTATUS[*]} .
+	set -o pipefail
+	(exit 12) | :
+	echo 4 $? , ${PIPESTATUS[*]} .
+	yes | read n; echo 5 $n .
+	for i in 1 2 3; do echo $i | { read n; [[ $n = 2 ]] && break; }; done
+	echo 6 $n .
+expected-stdout:
+	1 0 .
+	2 3 .
+	3 3 , 12 3 .
+	4 12 , 12 0 .
+	5 y .
+	6 2 .
+---
 name: persist-history-1
 description:
 	Check if persistent history saving works
@@ -7788,6 +7978,290 @@ stdin:
 expected-stdout-pattern:
 	/^4 3 2 <> <\0>$/
 ---
+name: shf-bufsize
+description:
+	Buffers of files and pipes grow with the traffic; check that
+	nothing is lost or reordered on the way
+stdin:
+	typeset -i i=0
+	while (( i < 9000 )); do
+		print "echo $((i++)) \\"
+		print "    $i"
+	done >x
+	"$__progname" x >y
+	"$__progname" x | while read a b; do print -r -- $a $b; done >z
+	set -A a
+	while (( i < 12000 )); do a[i]=$((i++)); done
+	typeset -p a >w
+	wc -l <y; cmp -s y z && echo same
+	head -n 1 y; tail -n 1 y; wc -c <w
+expected-stdout:
+	9000
+	same
+	0 1
+	8999 9000
+	67010
+---
+name: script-file-lines
+description:
+	Script files are lexed from the read buffer where possible;
+	check lines across buffer boundaries, NULs, and a script file
+	that is changed while it runs
+stdin:
+	typeset -i i=0
+	while (( i < 3000 )); do
+		print -r -- "x=\"$i\"; if (( x % 1000 == 999 )); then"
+		print -r -- "	echo \$LINENO:\$x; fi # ${RANDOM}${RANDOM}"
+		let i++
+	done >s1
+	print 'echo "a\0b\\' >s2
+	print '"c' >>s2
+	print 'echo one' >s3
+	print 'echo echo two >>"$0"' >>s3
+	"$__progname" s1
+	"$__progname" s2
+	"$__progname" s3
+expected-stdout:
+	2000:999
+	4000:1999
+	6000:2999
+	abc
+	one
+	two
+---
+name: script-file-truncated
+description:
+	Check that a script which truncates itself does not go on for
+	more than one small buffer's worth of lines
+stdin:
+	typeset -i i=0
+	while (( i++ < 3000 )); do
+		(( i == 1500 )) && print ': >s'
+		print "n=$i"
+	done >s
+	"$__progname" -x s 2>&1 | sed -n 's/^+ n=\([0-9]*\) $/\1/p' >x
+	typeset -i n=0
+	while read line; do
+		(( line > n )) && n=$line
+	done <x
+	(( n >= 1499 && n < 1600 )) && echo ok
+expected-stdout:
+	ok
+---
+name: shf-numbers
+description:
+	Check decimal conversions, in and outside of shf_vfprintf
+stdin:
+	typeset -i x
+	for x in 0 7 10 99 100 12345 -1 -10 -99 -100 2147483647; do
+		print -nr -- "$x "
+	done
+	echo $((-2147483647 - 1))
+	printf '%d %i %u %d%%%s%c\n' 0 -5 4294967295 1000000 x y
+	printf '%d %d %d\n' 1 12 123 | while read -r a; do echo "<$a>"; done
+	set -x
+	: $((1 + 41))
+expected-stdout:
+	0 7 10 99 100 12345 -1 -10 -99 -100 2147483647 -2147483648
+	0 -5 4294967295 1000000%xy
+	<1 12 123>
+expected-stderr:
+	+ : 42
+---
+name: cat-copy
+description:
+	Check that the cat builtin copies files intact between regular
+	files, pipes and command substitutions, also past its buffer
+stdin:
+	i=0
+	while (( i++ < 3000 )); do
+		print line $i
+	done >a
+	cat a >b
+	cat a | cat >c
+	cat <a | cat - a >>d
+	cat a a | cmp - d && echo append ok
+	x=$(cat a)
+	print -r -- "$x" >e
+	for f in b c e; do
+		cmp -s a $f && echo $f ok
+	done
+	cat a nonexistent a 2>/dev/null | wc -l | tr -d ' '
+expected-stdout:
+	append ok
+	b ok
+	c ok
+	e ok
+	6000
+---
+name: print-order
+description:
+	Check that print output collected in a buffer is still written
+	in order with other output to the same file
+stdin:
+	{
+		echo a
+		echo b >&2
+		print c
+		"$__progname" -c 'echo d'
+		print -u2 e
+		echo f
+		(echo g; exit 1)
+		exec 3>x
+		print -u3 h
+		read line <x
+		echo $line
+		nonexistent-cmd 2>/dev/null
+		sleep 0
+		echo i
+	} >o 2>&1
+	cat o
+expected-stdout:
+	a
+	b
+	c
+	d
+	e
+	f
+	g
+	h
+	i
+---
+name: print-unbuffered
+description:
+	Check that print output to files, and to pipes with SIGPIPE
+	ignored, is written right away so that errors are seen
+stdin:
+	exec 3>x
+	print -u3 hello
+	[[ -s x ]] && echo written
+	{ print -u4 one; exec 4>y; print -u4 two; [[ -s y ]] && echo two; } 4>&1 | cat
+	{ trap '' 13; sleep 1; print foo; echo $? >&2; } | :
+expected-stdout:
+	written
+	one
+	two
+expected-stderr:
+	1
+---
+name: printf-builtin-1
+description:
+	Check the printf builtin: format reuse, conversions, -v
+stdin:
+	printf '%s=%d;' a 1 b 2 c; echo
+	printf '<%5.2s|%-4d|%04x|%o|%X|%c>\n' abc 7 255 8 255 hello
+	printf '%b|%q\n' 'a\tb\0101' "it's"
+	printf '%d %d %d %u\n' "'A" 0x10 -3 5
+	printf '%*d|%.*s|%%\n' 5 42 2 abcdef
+	printf '%b.\n' 'x\cy' z
+	printf -v v '%03d' 5; echo "<$v>"
+	printf '%d\n' 1x 2>/dev/null; echo $?
+	printf '%y\n' 2>/dev/null; echo $?
+expected-stdout:
+	a=1;b=2;c=0;
+	<   ab|7   |00ff|10|FF|h>
+	a	bA|'it'\''s'
+	65 16 -3 5
+	   42|ab|%
+	x<005>
+	1
+	1
+	1
+---
+name: printf-builtin-2
+description:
+	Check printf with repeated flags, wide arguments for '*' and
+	the precision of numbers
+stdin:
+	printf '%-+ #0-+*.*d|\n' -5 3 1
+	printf '%-+ #0-+*.*s|\n' -4 2147483647 ab
+	printf '%*d|\n' -2147483648 1 2>/dev/null; echo $?
+	printf '%5.3d|%-5.3d|%+.3d|%.0d|%#.4x|%#.0x|%#.3o\n' 7 7 -7 0 255 0 8
+expected-stdout:
+	+001 |
+	ab  |
+	1|
+	1
+	  007|007  |-007||0x00ff||010
+---
+name: textutil-head-tail
+description:
+	Check the head and tail builtins on files and pipes
+stdin:
+	i=0
+	while (( i++ < 20000 )); do
+		print $i
+	done >a
+	head -n 2 a; head -c 3 a; echo
+	tail -n 2 a; tail -c 6 a
+	tail -n +19999 a
+	cat a | tail -n 1; cat a | tail -n +20000
+	{ head -n 1; head -n 1; } <a
+	x=$(head -n 1 a); echo $x
+	head -n 1 a a
+expected-stdout:
+	1
+	2
+	1
+	2
+	19999
+	20000
+	20000
+	19999
+	20000
+	20000
+	20000
+	1
+	2
+	1
+	==> a <==
+	1
+	
+	==> a <==
+	1
+---
+name: textutil-wc-tr
+description:
+	Check the wc and tr builtins
+stdin:
+	printf 'one two\nthree\n' >a
+	wc a; wc -l <a; wc -w -c a a
+	echo Hello, World | tr a-z A-Z
+	echo hello | tr '[:lower:]' '[:upper:]'
+	echo 'a-b c' | tr -d ' -'
+	echo abcabc | tr abc xy
+	print -n 'a\tb' | tr '\t' :; echo
+expected-stdout:
+	2 3 14 a
+	2
+	3 14 a
+	3 14 a
+	6 28 total
+	HELLO, WORLD
+	HELLO
+	abc
+	xyyxyy
+	a:b
+---
+name: textutil-external
+description:
+	Check that the external utilities run for unsupported options
+stdin:
+	for x in head tail tr wc; do
+		print "echo external $x \"\$@\"" >$x
+		chmod +x $x
+	done
+	PATH=.:$PATH
+	head -v a; tail -f b; tr -s a b; wc -L c; tr '[a*]' b
+	echo x | head -n 1
+expected-stdout:
+	external head -v a
+	external tail -f b
+	external tr -s a b
+	external wc -L c
+	external tr [a*] b
+	x
+---
 name: print-escapes
 description:
 	Check backslash expansion by the print builtin
@@ -9179,6 +9653,112 @@ expected-stdout:
 		./pfn "$(echo foo )" 
 	} 
 ---
+name: comsub-6
+description:
+	Check COMSUB run without forking still behaves like a subshell
+stdin:
+	bn() {
+		typeset x=$1
+		print -r -- "${x##*/}"
+	}
+	e() {
+		echo e1
+		echo e2 >&2
+		echo e3
+	}
+	x=1
+	y=$(bn /usr/lib/libc.so.1); echo 1 $y $?
+	y=$(x=2; echo $x); echo 2 $y $x
+	y=$(e 2>/dev/null); echo 3 $y
+	y=$(e 2>&1); echo 4 $y
+	y=$(echo "$(bn a/b)" c; false); echo 5 $y $?
+	y=$(print -n a; print b | tr b c); echo 6 $y
+	y=$([[ -n $x ]] && echo t || echo f); echo 7 $y
+	y=$(echo ${x:+set} ${z:-unset}); echo 8 $y $z
+	y=$(echo ${z:=set}); echo 9 $y $z
+expected-stdout:
+	1 libc.so.1 0
+	2 2 1
+	3 e1 e3
+	4 e1 e2 e3
+	5 b c 1
+	6 ac
+	7 t
+	8 set unset
+	9 set
+---
+name: comsub-7
+description:
+	Check $(<file) reads regular files and others alike
+stdin:
+	print -n 'a  b\0c\n\nd e\n\n\n' >x
+	y=$(<x); print -r -- "1<$y>"
+	set -- $(<x); print -r -- "2 $#<$*>"
+	:>x
+	y=$(<x); print -r -- "3<$y>"
+	y=$(</dev/null); print -r -- "4<$y>"
+	print foo | { y=$(</dev/stdin); print -r -- "5<$y>"; }
+expected-stdout:
+	1<a  bc
+	
+	d e>
+	2 4<a bc d e>
+	3<>
+	4<>
+	5<foo>
+---
+name: comsub-8
+description:
+	Check that large command substitution output, which is
+	copied in runs, is still split, globbed and trimmed correctly
+stdin:
+	x=$(i=0; while (( i++ < 200 )); do print -n 'abcdefgh ij\t?\n'; done; print; print; exit 0)
+	print ${#x}
+	set -f
+	set -- $x
+	print $# "$1" "$2" "$3" "${x:2790}"
+	IFS=:; set -- $(print -n 'a b:c~d::*e'; exit 0)
+	print $# "$1|$2|$3|$4"
+	set +f
+	:>ax29
+	print *x$(print 29)
+expected-stdout:
+	2799
+	600 abcdefgh ij ? efgh ij	?
+	4 a b|c~d||*e
+	ax29
+---
+name: comsub-9
+description:
+	Check the xtrace output of COMSUB and FUNSUB run without forking
+stdin:
+	set -x
+	x=$(print hi)
+	y=$(echo a) z=${ print b; }
+	print $x $y $z
+expected-stdout:
+	hi a b
+expected-stderr:
+	+ print hi
+	+ x=hi 
+	+ echo a
+	+ print b
+	+ y=a z=b 
+	+ print hi a b
+---
+name: comsub-10
+description:
+	Check that $BASHPID in COMSUB is that of the subshell
+stdin:
+	p=$BASHPID
+	[[ $(echo $BASHPID) != $p ]] && echo ok1
+	[[ $(print -r -- "${BASHPID}") != $p ]] && echo ok2
+	[[ $(echo ${BASHPID:-x}) != $p ]] && echo ok3
+expected-stdout:
+	ok1
+	ok2
+	ok3
+---
 name: comsub-torture
 description:
 	Check the tree dump functions work correctly
@@ -10231,6 +10811,22 @@ expected-stdout:
 	2:ya x2,1,0.
 	3:ya,1,3.
 ---
+name: funsub-3
+description:
+	Check funsub output is kept in order when a real fd is needed
+stdin:
+	x=${ echo a; echo b | tr b B; { echo c >&2; } 2>&1; echo d; }
+	echo 1 $x
+	x=${ echo e; (echo f); print g; }
+	echo 2 $x
+	typeset -i i=0
+	x=${ while (( i++ < 3000 )); do print $i; done; }
+	echo 3 ${#x} $i ${x%%$'\n'*} ${x##*$'\n'}
+expected-stdout:
+	1 a B c d
+	2 e f g
+	3 13892 3001 1 3000
+---
 name: valsub-1
 description:
 	Check that "value substitutions" work as advertised
@@ -10263,6 +10859,25 @@ expected-stdout:
 	typeset t=$'foo\n\n'
 	this used to segfault.
 ---
+name: test-file-cache
+description:
+	Chained file tests on one pathname may share their stat(2),
+	but never across a command run inside the expression
+stdin:
+	:>a; ln -s a l
+	[[ -f a && -z $(rm a) && -f a ]] || echo gone
+	:>a
+	[[ -h l && -f l && -r l && ! -d l && -e l ]] && echo chain
+	[[ -f a && -h a ]] || echo nolink
+	test -f a -a -r a -a a -ef l && echo posix
+	[[ -e a && $(rm a; echo x) = x && ! -e a && ! -e l ]] && echo again
+expected-stdout:
+	gone
+	chain
+	nolink
+	posix
+	again
+---
 name: test-stnze-1
 description:
 	Check that the short form [ $x ] works
@@ -10986,6 +11601,81 @@ expected-stdout:
 	//usr/lib
 	//usr/bin
 ---
+name: basename-dirname
+description:
+	Check the basename and dirname builtins
+stdin:
+	for s in "" / // a/ /a/ a/b //a//b// . "x y/z w"; do
+		print -r -- "[$s] [$(basename "$s")] [$(dirname "$s")]"
+	done
+	basename foo.c .c; basename .c .c; basename -s .c a.c b/c.c
+	basename a b c 2>/dev/null; echo $?
+	dirname a/b c/d/e
+expected-stdout:
+	[] [] [.]
+	[/] [/] [/]
+	[//] [/] [/]
+	[a/] [a] [.]
+	[/a/] [a] [/]
+	[a/b] [b] [a]
+	[//a//b//] [b] [//a]
+	[.] [.] [.]
+	[x y/z w] [z w] [x y]
+	foo
+	.c
+	a
+	c
+	1
+	a
+	c/d
+---
+name: mkdir-builtin
+description:
+	Check the mkdir builtin
+stdin:
+	umask 022
+	mkdir a; mkdir a 2>/dev/null; echo $?
+	mkdir -p a a/b//c/ && test -d a/b/c && echo p ok
+	mkdir -m 700 m1; mkdir -m u=rwx,go=x m2
+	umask 077
+	mkdir -p q/r
+	for d in m1 m2 q q/r; do
+		ls -ld $d | cut -c1-10
+	done
+	:>f; mkdir -p f/g 2>/dev/null; echo $?
+expected-stdout:
+	1
+	p ok
+	drwx------
+	drwx--x--x
+	drwx------
+	drwx------
+	1
+---
+name: pathutil-external
+description:
+	Check that the external basename, dirname and mkdir are run
+	for options the builtins do not know
+stdin:
+	for x in basename dirname mkdir; do
+		print "echo external $x \"\$@\"" >$x
+		chmod +x $x
+	done
+	PATH=.:$PATH
+	mkdir -pv d1/d2; mkdir --parents a/b
+	basename --suffix=.c a.c; dirname -z a/b
+	x=$(basename -x y); echo $x
+	basename -s .c a.c; dirname a/b; mkdir -p c/d && echo builtin
+expected-stdout:
+	external mkdir -pv d1/d2
+	external mkdir --parents a/b
+	external basename --suffix=.c a.c
+	external dirname -z a/b
+	external basename -x y
+	a
+	a
+	builtin
+---
 name: crash-1
 description:
 	Crashed during March 2011, fixed on vernal equinōx ☺
@@ -11193,3 +11883,52 @@ expected-stdout:
 expected-stderr-pattern:
 	/.*/
 ---
+name: xtrace-batch
+description:
+	Check that held trace lines keep their place among other output
+stdin:
+	exec 2>&1
+	echo c >x
+	set -o xtrace-batch -x
+	echo a
+	print -u2 b
+	sed -n p x
+	: d
+	(echo e)
+	set +x
+	echo f
+expected-stdout:
+	+ echo a
+	a
+	+ print -u2 b
+	b
+	+ sed -n p x
+	c
+	+ : d
+	+ echo e
+	e
+	+ set +x
+	f
+---
+name: xtrace-fd
+description:
+	Check that XTRACEFD sends the trace elsewhere, and back
+stdin:
+	exec 3>trace
+	set -x
+	XTRACEFD=3
+	: one
+	unset XTRACEFD
+	: two
+	set +x
+	echo =; cat trace
+	XTRACEFD=99
+	echo notreached
+expected-stdout:
+	=
+	+ : one
+	+ unset XTRACEFD
+expected-stderr-pattern:
+	/^\+ XTRACEFD=3 \n\+ : two\n\+ set \+x\n.*XTRACEFD: bad number: 99\n$/
+expected-exit: e != 0
+---
@@ -63,12 +63,28 @@ typedef struct {
 #define IFS_WS		1	/* have seen IFS white-space */
 #define IFS_NWS		2	/* have seen IFS non-white-space */
 
+/* comsub_word() result flags */
+#define CW_LITERAL	BIT(0)	/* no substitutions at all */
+#define CW_SPLIT	BIT(1)	/* unquoted substitution, may be split */
+#define CW_IMPURE	BIT(2)	/* may change the shell state */
+
+/* temporary file and saved stdout once capsub() output was spilt */
+static int capsub_tfd = -1;
+static short capsub_ofd1;
+
 static int varsub(Expand *, const char *, const char *, int *, int *);
 static int comsub(Expand *, const char *, int);
 static char *valsub(struct op *, Area *);
+static bool comsub_nofork(struct op *, int);
+static int comsub_word(const char *);
+static struct shf *capsub(struct op *);
+static struct shf *comsub_file(const char *);
+static int capsub_exec(struct op *);
+static size_t comsub_plain(struct shf *, bool, bool);
 static char *trimsub(char *, char *, int);
 static void glob(char *, XPtrV *, bool);
 static void globit(XString *, char **, char *, XPtrV *, int);
+static void globstar(XString *, char **, char *, XPtrV *, int, int);
 static const char *maybe_expand_tilde(const char *, XString *, char **, int);
 #ifndef MKSH_NOPWNAM
 static char *homedir(char *);
@@ -861,6 +877,18 @@ expand(
 				/* spit out saved NLs */
 				c = '\n';
 				--newlines;
+			} else if (!make_magic && (len = comsub_plain(x.u.shf,
+			    !quote && (f & DOBLANK) && doblank, tobool(quote)))) {
+				/* copy a run of ordinary bytes in one go */
+				XcheckN(ds, dp, len);
+				memcpy(dp, x.u.shf->rp, len);
+				dp += len;
+				x.u.shf->rp += len;
+				x.u.shf->rnleft -= len;
+				/* age tilde_ok info as if done bytewise */
+				tilde_ok = len > 1 ? 0 : tilde_ok << 1;
+				word = IFS_WORD;
+				continue;
 			} else {
 				while ((c = shf_getc(x.u.shf)) == 0 || c == '\n')
 					if (c == '\n')
@@ -1041,6 +1069,29 @@ expand(
 	}
 }
 
+/*
+ * Length of the run of bytes buffered in the command substitution
+ * output shf which expand() can copy without looking at them: no
+ * newlines, NULs, MAGIC or (if splitting) IFS characters, and none
+ * of the characters that need marking for later passes if unquoted.
+ */
+static size_t
+comsub_plain(struct shf *shf, bool split, bool quoted)
+{
+	const unsigned char *s = shf->rp, *e = s + shf->rnleft;
+	int c;
+
+	while (s < e) {
+		c = *s;
+		if (c == 0 || c == '\n' || ISMAGIC(c) ||
+		    (split && ctype(c, C_IFS)) || (!quoted &&
+		    !ctype(c, C_ALPHA | C_DIGIT) && vstrchr("[!-]*?{},=:~", c)))
+			break;
+		++s;
+	}
+	return (s - shf->rp);
+}
+
 /*
  * Prepare to generate the string returned by ${} substitution.
  */
@@ -1321,55 +1372,39 @@ comsub(Expand *xp, const char *cp, int fn MKSH_A_UNUSED)
 		if ((io->flag & IOTYPE) != IOREAD)
 			errorf("%s: %s", "funny $() command",
 			    snptreef(NULL, 32, "%R", io));
-		shf = shf_open(name = evalstr(io->name, DOTILDE), O_RDONLY, 0,
-			SHF_MAPHI|SHF_CLEXEC);
-		if (shf == NULL)
+		if ((shf = comsub_file(name = evalstr(io->name,
+		    DOTILDE))) == NULL)
 			warningf(!Flag(FTALKING), "%s: %s %s: %s", name,
 			    "can't open", "$(<...) input", cstrerror(errno));
-	} else if (fn == FUNSUB) {
-		int ofd1;
-		struct temp *tf = NULL;
-
+	} else if (fn == FUNSUB || (fn == COMSUB && !Flag(FERREXIT) &&
+	    !Flag(FNOUNSET) && !sigtraps[ksh_SIGEXIT].trap &&
+	    !sigtraps[ksh_SIGERR].trap && comsub_nofork(t, 0))) {
 		/*
-		 * create a temporary file, open for reading and writing,
-		 * with an shf open for reading (buffered) but yet unused
+		 * run tree in a new function block, with output captured
+		 * in memory, spilt into a tempfile only if need be; COMSUB
+		 * if it cannot change the shell state, so the subshell
+		 * needs no fork of its own
 		 */
-		maketemp(ATEMP, TT_FUNSUB, &tf);
-		if (!tf->shf) {
-			errorf("can't %s temporary file %s: %s",
-			    "create", tf->tffn, cstrerror(errno));
-		}
-		/* extract shf from temporary file, unlink and free it */
-		shf = tf->shf;
-		unlink(tf->tffn);
-		afree(tf, ATEMP);
-		/* save stdout and let it point to the tempfile */
-		ofd1 = savefd(1);
-		ksh_dup2(shf_fileno(shf), 1, false);
-		/*
-		 * run tree, with output thrown into the tempfile,
-		 * in a new function block
-		 */
-		valsub(t, NULL);
-		subst_exstat = exstat & 0xFF;
-		/* rewind the tempfile and restore regular stdout */
-		lseek(shf_fileno(shf), (off_t)0, SEEK_SET);
-		restfd(1, ofd1);
+		shf = capsub(t);
 	} else if (fn == VALSUB) {
 		xp->str = valsub(t, ATEMP);
 		subst_exstat = exstat & 0xFF;
 		return (XSUB);
 	} else {
 		int ofd1, pv[2];
+		struct shf *ocap = shl_capture;
 
 		openpipe(pv);
-		shf = shf_fdopen(pv[0], SHF_RD, NULL);
+		shf = shf_fdopen(pv[0], SHF_RD | SHF_DYNAMIC, NULL);
 		ofd1 = savefd(1);
 		if (pv[1] != 1) {
 			ksh_dup2(pv[1], 1, false);
 			close(pv[1]);
 		}
+		/* the child writes into the pipe, not into our capture */
+		shl_capture = NULL;
 		execute(t, XXCOM | XPIPEO | XFORK, NULL);
+		shl_capture = ocap;
 		restfd(1, ofd1);
 		startlast();
 		/* waitlast() */
@@ -1547,7 +1582,8 @@ globit(XString *xs,	/* dest string */
 		return;
 	}
 
-	if (xp > Xstring(*xs, xp))
+	/* globstar() passes directory names with the slash appended */
+	if (xp > Xstring(*xs, xp) && xp[-1] != '/')
 		*xp++ = '/';
 	while (*sp == '/') {
 		Xcheck(*xs, xp);
@@ -1572,7 +1608,29 @@ globit(XString *xs,	/* dest string */
 	 * directory isn't readable - if no globbing is needed, only execute
 	 * permission should be required (as per POSIX)).
 	 */
-	if (!has_globbing(sp, se)) {
+	if (Flag(FGLOBSTAR) && se - sp == 4 && ISMAGIC(sp[0]) &&
+	    sp[1] == '*' && ISMAGIC(sp[2]) && sp[3] == '*') {
+		/* ** matches zero or more directories */
+		char star[3];
+		int fd = -1;
+
+		*xp = '\0';
+		if (np == NULL) {
+			/* trailing **, match anything at all levels */
+			star[0] = MAGIC;
+			star[1] = '*';
+			star[2] = '\0';
+		}
+#if HAVE_OPENAT
+		fd = open(Xlength(*xs, xp) ? Xstring(*xs, xp) : ".",
+		    O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			goto Nodir;
+#endif
+		*xpp = xp;
+		globstar(xs, xpp, np ? np : star, wp,
+		    (check & GF_MARKDIR) | GF_GLOBBED, fd);
+	} else if (!has_globbing(sp, se)) {
 		XcheckN(*xs, xp, se - sp + 1);
 		debunk(xp, sp, Xnleft(*xs, xp));
 		xp += strlen(xp);
@@ -1610,14 +1668,99 @@ globit(XString *xs,	/* dest string */
 			xp = Xstring(*xs, xp) + prefix_len;
 		}
 		closedir(dirp);
- Nodir:
-		;
 	}
-
+ Nodir:
 	if (np != NULL)
 		*--np = odirsep;
 }
 
+/*
+ * Apply the pattern sp below **: match it in the directory named by
+ * the contents of xs, which is either empty or ends with a slash, and
+ * in all its subdirectories. Names starting with a dot and symbolic
+ * links are not descended into, so there are no loops to catch. With
+ * openat(), the walk is done relative to fd, which is closed here.
+ * If the first component of sp is a pattern, it is matched against
+ * the names read for the walk, so each directory is only read once.
+ */
+static void
+globstar(XString *xs, char **xpp, char *sp, XPtrV *wp, int check, int fd)
+{
+	DIR *dirp;
+	struct dirent *d;
+	char *name, *xp, *np, *pat = NULL;
+	size_t len, prefix_len;
+#if !HAVE_OPENAT
+	struct stat sb;
+#endif
+
+	prefix_len = Xlength(*xs, *xpp);
+	if ((np = strchr(sp, '/')) == NULL)
+		np = sp + strlen(sp);
+	if (has_globbing(sp, np) && !(np - sp == 4 && ISMAGIC(sp[0]) &&
+	    sp[1] == '*' && ISMAGIC(sp[2]) && sp[3] == '*')) {
+		strndupx(pat, sp, np - sp, ATEMP);
+		np = *np ? np + 1 : NULL;
+	} else
+		globit(xs, xpp, sp, wp, check | GF_EXCHECK);
+	xp = Xstring(*xs, *xpp) + prefix_len;
+
+#if HAVE_OPENAT
+	if ((dirp = fdopendir(fd)) == NULL) {
+		close(fd);
+		goto out;
+	}
+#else
+	*xp = '\0';
+	if ((dirp = opendir(prefix_len ? Xstring(*xs, xp) : ".")) == NULL)
+		goto out;
+#endif
+	while ((d = readdir(dirp)) != NULL) {
+		name = d->d_name;
+		if (pat != NULL && (*name != '.' || (*pat == '.' &&
+		    name[1] != '\0' && (name[1] != '.' || name[2] != '\0'))) &&
+		    gmatchx(name, pat, true)) {
+			/* as in globit(), for the rest of the pattern */
+			len = strlen(name) + 1;
+			XcheckN(*xs, xp, len);
+			memcpy(xp, name, len);
+			*xpp = xp + len - 1;
+			globit(xs, xpp, np, wp,
+			    check | (np ? GF_EXCHECK : GF_NONE));
+			xp = Xstring(*xs, xp) + prefix_len;
+		}
+		/* also skips . and .. */
+		if (*name == '.')
+			continue;
+#ifdef DT_DIR
+		/* avoid opening or stat(2)ing what is known to not qualify */
+		if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+			continue;
+#endif
+		len = strlen(name);
+		XcheckN(*xs, xp, len + 2);
+		memcpy(xp, name, len + 1);
+#if HAVE_OPENAT
+		/* fails for symbolic links and anything not a directory */
+		if ((fd = openat(dirfd(dirp), name,
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW)) < 0)
+			continue;
+#else
+		if (mksh_lstat(Xstring(*xs, xp), &sb) < 0 ||
+		    !S_ISDIR(sb.st_mode))
+			continue;
+#endif
+		xp[len] = '/';
+		xp[len + 1] = '\0';
+		*xpp = xp + len + 1;
+		globstar(xs, xpp, sp, wp, check, fd);
+		xp = Xstring(*xs, xp) + prefix_len;
+	}
+	closedir(dirp);
+ out:
+	afree(pat, ATEMP);
+}
+
 /* remove MAGIC from string */
 char *
 debunk(char *dp, const char *sp, size_t dlen)
@@ -1834,3 +1977,402 @@ valsub(struct op *t, Area *ap)
 
 	return (cp);
 }
+
+/*
+ * Check whether a command substitution can be run in the current
+ * environment instead of a forked subshell: only builtins that do
+ * no more than write to stdout, and functions (depth > 0) made up
+ * of them, none of which can change the state of the shell.
+ */
+static bool
+comsub_nofork(struct op *t, int depth)
+{
+	const char **wp, *cp;
+	struct ioword **iowp;
+	struct tbl *tp;
+	Test_op op;
+	int i;
+
+	if (t == NULL)
+		return (true);
+	if ((iowp = t->ioact) != NULL)
+		for (; *iowp != NULL; iowp++)
+			if (((*iowp)->flag & IOTYPE) == IOHERE ||
+			    (comsub_word((*iowp)->name) & CW_IMPURE))
+				return (false);
+
+	switch (t->type) {
+	case TEOF:
+		/* "then" part of TIF and TELIF */
+	case TLIST:
+	case TOR:
+	case TAND:
+	case TBANG:
+	case TIF:
+	case TELIF:
+	case TWHILE:
+	case TUNTIL:
+	case TBRACE:
+		break;
+	case TCASE:
+		if (comsub_word(t->str) & CW_IMPURE)
+			return (false);
+		break;
+	case TPAT:
+		for (wp = (const char **)t->vars; *wp != NULL; wp++)
+			if (comsub_word(*wp) & CW_IMPURE)
+				return (false);
+		break;
+	case TDBRACKET:
+		for (wp = t->args; *wp != NULL; wp++)
+			if ((i = comsub_word(*wp)) & CW_IMPURE)
+				return (false);
+			else if (i & CW_LITERAL) {
+				cp = wdstrip(*wp, 0);
+				/* integer operands are arithmetic expressions */
+				if ((op = test_isop(TM_BINOP, cp)) >=
+				    TO_INTEQ && op <= TO_INTLE)
+					return (false);
+				/* fd 1 is not the pipe in here */
+				if (!strcmp(cp, "-t"))
+					return (false);
+			}
+		break;
+	case TCOM:
+		if (*t->vars != NULL || *t->args == NULL ||
+		    !(comsub_word(*t->args) & CW_LITERAL))
+			return (false);
+		for (wp = t->args + 1; *wp != NULL; wp++)
+			if (comsub_word(*wp) & CW_IMPURE)
+				return (false);
+		cp = wdstrip(*t->args, 0);
+		if ((tp = findcom(cp, FC_BI | FC_FUNC)) == NULL)
+			return (false);
+		if (tp->type == CFUNC)
+			/* recursion is not worth following */
+			return ((tp->flag & ISSET) && depth < 8 &&
+			    comsub_nofork(tp->val.t, depth + 1));
+		if (tp->type != CSHELL)
+			return (false);
+		if (tp->val.f == c_print) {
+			/* echo has no -s */
+			if (*cp != 'p')
+				return (true);
+			/* not "print -s", it writes to the history */
+			for (wp = t->args + 1; *wp != NULL; wp++) {
+				if (!(comsub_word(*wp) & CW_LITERAL))
+					return (false);
+				cp = wdstrip(*wp, 0);
+				if (*cp != '-' || !cp[1] || !strcmp(cp, "--"))
+					break;
+				if (vstrchr(cp, 's'))
+					return (false);
+			}
+			return (true);
+		}
+		if (tp->val.f == c_test) {
+			/* whether the next word may be a unary operator */
+			bool unop = true;
+			const char *s;
+
+			for (wp = t->args + 1; *wp != NULL; wp++) {
+				/* cannot tell operands from operators */
+				if ((i = comsub_word(*wp)) & CW_SPLIT)
+					return (false);
+				if (!(i & CW_LITERAL)) {
+					/*
+					 * could be -t, unless followed by a
+					 * binary operator or the closing ]
+					 */
+					if (unop && wp[1] != NULL &&
+					    (*cp != '[' || wp[2] != NULL) &&
+					    (!(comsub_word(wp[1]) & CW_LITERAL) ||
+					    test_isop(TM_BINOP, wdstrip(wp[1],
+					    0)) == TO_NONOP))
+						return (false);
+					unop = false;
+					continue;
+				}
+				s = wdstrip(*wp, 0);
+				/* integer operands are arithmetic expressions */
+				if ((op = test_isop(TM_BINOP, s)) >= TO_INTEQ &&
+				    op <= TO_INTLE)
+					return (false);
+				/* fd 1 is not the pipe in here, see above */
+				if (!strcmp(s, "-t"))
+					return (false);
+				unop = !strcmp(s, "!") || !strcmp(s, "(") ||
+				    !strcmp(s, "-a") || !strcmp(s, "-o");
+			}
+			return (true);
+		}
+		if (!strcmp(cp, "typeset") && depth) {
+			/* local variables only, no options */
+			for (wp = t->args + 1; *wp != NULL; wp++) {
+				cp = *wp;
+				if (cp[0] != CHAR || !ksh_isalphx(cp[1]))
+					return (false);
+				while (cp[0] == CHAR && ksh_isalnux(cp[1]))
+					cp += 2;
+				if (cp[0] != EOS && (cp[0] != CHAR || cp[1] != '='))
+					return (false);
+			}
+			return (true);
+		}
+		/* positional parameters are only private to functions */
+		if ((!strcmp(cp, "return") || !strcmp(cp, "shift")) && depth)
+			return (true);
+		if (tp->val.f == c_basename || tp->val.f == c_dirname
+#ifdef MKSH_TEXT_BUILTINS
+		    || textutil_builtin(tp->val.f)
+#endif
+		    ) {
+			const char **av;
+
+			/* only if comexec() will not run the utility */
+			for (i = 0; t->args[i] != NULL; i++)
+				if (!(comsub_word(t->args[i]) & CW_LITERAL))
+					return (false);
+			av = alloc2(i + 1, sizeof(char *), ATEMP);
+			av[i] = NULL;
+			while (i--)
+				av[i] = wdstrip(t->args[i], 0);
+			return (!builtin_external(tp->val.f, av));
+		}
+		return (tp->val.f == c_brkcont || tp->val.f == c_pwd ||
+		    tp->val.f == c_realpath || !strcmp(cp, "true") ||
+		    !strcmp(cp, "false") || !strcmp(cp, ":"));
+	default:
+		return (false);
+	}
+	return (comsub_nofork(t->left, depth) &&
+	    comsub_nofork(t->right, depth));
+}
+
+/* classify a compiled word for comsub_nofork(), see CW_* above */
+static int
+comsub_word(const char *wp)
+{
+	int rv = CW_LITERAL, quoted = 0;
+	const char *cp;
+
+	while (/* CONSTCOND */ 1)
+		switch (*wp++) {
+		case EOS:
+			return (rv);
+		case CHAR:
+		case QCHAR:
+		case ADELIM:
+		case OPAT:
+			wp++;
+			break;
+		case OQUOTE:
+			quoted++;
+			break;
+		case CQUOTE:
+			quoted--;
+			break;
+		case SPAT:
+		case CPAT:
+			break;
+		case CSUBST:
+			wp++;
+			break;
+		case COMSUB:
+			/* decided upon on its own when it is expanded */
+			wp = cstrchr(wp, '\0') + 1;
+			rv = (rv & ~CW_LITERAL) | (quoted ? 0 : CW_SPLIT);
+			break;
+		case OSUBST:
+			/* OSUBST [{x] name \0 word CSUBST [}x] */
+			rv = (rv & ~CW_LITERAL) | (quoted ? 0 : CW_SPLIT);
+			/* array indices are arithmetic expressions */
+			if ((cp = cstrchr(++wp, '[')) != NULL &&
+			    !((cp[1] == '*' || cp[1] == '@') && cp[2] == ']')) {
+				while (ksh_isdigit(*++cp))
+					;
+				if (*cp != ']')
+					return (CW_IMPURE);
+			}
+			if (special_subshell(wp))
+				return (CW_IMPURE);
+			wp = cstrchr(wp, '\0') + 1;
+			if (wp[0] == CSUBST)
+				break;
+			/* no assignment, error or substring (arithmetic) */
+			cp = wp[0] == CHAR && wp[1] == ':' ? wp + 2 : wp;
+			if (cp[0] != CHAR || !vstrchr("+-#%/@", cp[1]))
+				return (CW_IMPURE);
+			break;
+		default:
+			/* EXPRSUB, FUNSUB, VALSUB */
+			return (CW_IMPURE);
+		}
+}
+
+/*
+ * Run a command substitution in the current environment, with its
+ * stdout captured in memory; it is only spilt into a temporary file
+ * (see comsub_spill() below) if a real file descriptor is needed.
+ */
+static struct shf *
+capsub(struct op *t)
+{
+	struct shf *shf, *cap, *ocap = shl_capture;
+	int i, otfd = capsub_tfd;
+	short oofd1 = capsub_ofd1;
+	ssize_t len, xlen = 0;
+	char *cp, *xline = NULL;
+	unsigned char *lp;
+
+	if (Flag(FXTRACE) == 2) {
+		/*
+		 * set -x: the trace line of the command this is expanded
+		 * for is begun; take it out, so that of the commands run
+		 * in here comes first, and put it back afterwards
+		 */
+		lp = shl_xtrace->wp;
+		while (lp > shl_xtrace->buf && lp[-1] != '\n')
+			--lp;
+		xlen = shl_xtrace->wp - lp;
+		xline = alloc(xlen + 1, ATEMP);
+		memcpy(xline, lp, xlen);
+		shl_xtrace->wp = lp;
+		shl_xtrace->wnleft += xlen;
+		Flag(FXTRACE) = 1;
+	}
+	shl_capture = cap = shf_sopen(NULL, 0, SHF_WR | SHF_DYNAMIC, NULL);
+	capsub_tfd = -1;
+	i = capsub_exec(t);
+	subst_exstat = exstat & 0xFF;
+	if (xline != NULL) {
+		change_xtrace(1, false);
+		shf_write(xline, xlen, shl_xtrace);
+		Flag(FXTRACE) = 2;
+		afree(xline, ATEMP);
+	}
+	if (capsub_tfd != -1) {
+		/* rewind the tempfile and restore regular stdout */
+		bout_flush();
+		lseek(capsub_tfd, (off_t)0, SEEK_SET);
+		restfd(1, capsub_ofd1);
+		shf = shf_fdopen(capsub_tfd, SHF_RD | SHF_DYNAMIC, NULL);
+		afree(shf_sclose(cap), ATEMP);
+	} else {
+		len = cap->wp - cap->buf;
+		cp = shf_sclose(cap);
+		shf = shf_sopen(cp, len, SHF_RD, NULL);
+	}
+	shl_capture = ocap;
+	capsub_tfd = otfd;
+	capsub_ofd1 = oofd1;
+	/* do not let the substitution swallow an interrupt */
+	if (i == LINTR)
+		unwind(i);
+	return (shf);
+}
+
+/*
+ * Open the file for $(<file): regular files are read in one go into
+ * a buffer sized after fstat(2), with the trailing newlines already
+ * cut off; anything else (FIFOs, devices) is read via a normal shf.
+ */
+static struct shf *
+comsub_file(const char *name)
+{
+	struct stat sb;
+	size_t len = 0, bsize;
+	ssize_t n;
+	char *buf;
+	int fd, nfd;
+
+	if ((fd = open(name, O_RDONLY | O_BINARY)) < 0)
+		return (NULL);
+	if (fstat(fd, &sb) || !S_ISREG(sb.st_mode) ||
+	    (off_t)(size_t)sb.st_size != sb.st_size) {
+		/* like shf_open(..., SHF_MAPHI|SHF_CLEXEC) */
+		if ((nfd = savefd(fd)) != fd)
+			close(fd);
+		return (shf_fdopen(nfd, SHF_RD | SHF_DYNAMIC, NULL));
+	}
+
+	/* one octet more than needed, to see EOF; the file may grow */
+	bsize = (size_t)sb.st_size + 1;
+	buf = alloc(bsize, ATEMP);
+	while ((n = blocking_read(fd, buf + len, bsize - len)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/* like shf_getc(), treat read errors as EOF */
+			break;
+		}
+		if ((len += n) == bsize) {
+			buf = aresize2(buf, 2, bsize, ATEMP);
+			bsize <<= 1;
+		}
+	}
+	close(fd);
+
+	/* trailing newlines are removed anyway, see expand() */
+	while (len && buf[len - 1] == '\n')
+		--len;
+	return (shf_sopen(buf, len, SHF_RD, NULL));
+}
+
+/* helper function due to setjmp/longjmp woes */
+static int
+capsub_exec(struct op *t)
+{
+	int i;
+
+	newenv(E_FUNC);
+	newblock();
+	if (!(i = kshsetjmp(e->jbuf)))
+		execute(t, XXCOM | XERROK, NULL);
+	quitenv(NULL);
+	return (i);
+}
+
+/*
+ * stdout is about to be used as a real file descriptor while it is
+ * captured by capsub(): move what was written so far into a temporary
+ * file, which becomes stdout for the rest of the command substitution
+ */
+void
+comsub_spill(void)
+{
+	struct shf *cap;
+	struct temp *tf = NULL;
+	unsigned char *cp;
+	ssize_t n, w;
+
+	if ((cap = shl_capture) == NULL)
+		return;
+	shl_capture = NULL;
+
+	maketemp(ATEMP, TT_FUNSUB, &tf);
+	if (!tf->shf) {
+		errorf("can't %s temporary file %s: %s",
+		    "create", tf->tffn, cstrerror(errno));
+	}
+	/* only keep the fd, the shf belongs to an inner environment */
+	capsub_tfd = shf_fileno(tf->shf);
+	afree(tf->shf, ATEMP);
+	unlink(tf->tffn);
+	afree(tf, ATEMP);
+	capsub_ofd1 = savefd(1);
+	ksh_dup2(capsub_tfd, 1, false);
+
+	cp = cap->buf;
+	n = cap->wp - cap->buf;
+	while (n > 0) {
+		if ((w = write(1, cp, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			errorf("%s: %s", "can't write temporary file",
+			    cstrerror(errno));
+		}
+		cp += w;
+		n -= w;
+	}
+}
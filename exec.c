@@ -36,6 +36,10 @@ static int call_builtin(struct tbl *, const char **, const char *);
 static int iosetup(struct ioword *, struct tbl *);
 static int herein(struct ioword *, char **);
 static const char *do_selectargs(const char **, bool);
+static bool lastpipe_here(struct op *);
+static int execpfor(struct op *, const char **);
+static int pfor_temp(void);
+static void pfor_show(int, int);
 static Test_op dbteste_isa(Test_env *, Test_meta);
 static const char *dbteste_getopnd(Test_env *, Test_op, bool);
 static void dbteste_error(Test_env *, int, const char *);
@@ -44,6 +48,90 @@ static int search_access(const char *, int);
 static char *plain_fmt_entry(char *, size_t, unsigned int, const void *);
 static char *select_fmt_entry(char *, size_t, unsigned int, const void *);
 
+#ifndef MKSH_SMALL
+/*
+ * Cache of the names in the absolute directories searched by
+ * search_path(), so a lookup need not try every directory: a
+ * directory whose cache lacks the name is skipped without any
+ * system call. A directory is only read once it was searched a few
+ * times, which is not worth it for short-lived subshells. The caches
+ * are validated by the modification and change times of their
+ * directory, at most once per second; if the name is not found at
+ * all, search_path() searches again without them, so commands
+ * installed in between are still found.
+ */
+struct pathdir {
+	struct pathdir *next;
+	char **names;		/* sorted; NULL if not usable */
+	size_t nnames;
+	time_t checked;		/* last validation */
+	unsigned int uses;	/* lookups before the first scan */
+	time_t mtime, ctime;	/* of the directory when scanned */
+	char dir[4];		/* enlarged as needed */
+};
+
+static struct pathdir *pathdirs;
+
+static struct pathdir *pathdir_get(const char *, size_t);
+static void pathdir_scan(struct pathdir *);
+static int pathdir_has(struct pathdir *, const char *);
+#endif
+
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+/*
+ * Command hash file shared between shell instances: if HASHFILE
+ * names an absolute pathname, the commands found by searching the
+ * PATH are looked up there first. Its contents are only used if it
+ * was made for the same PATH, the modification and change times of
+ * all directories in it still match, and it belongs to us and is
+ * not writable by others. The main shell adds the commands it found
+ * when it exits, by writing a new file and renaming it over the old
+ * one, so concurrent readers and writers never see a partial file;
+ * if several shells write at once, the last one wins.
+ */
+struct hashfile_hdr {
+	char magic[8];
+	uint32_t ndirs;		/* struct hashfile_dir, then */
+	uint32_t keylen;	/* PATH with NUL, padded to 4, then */
+	uint32_t nent;		/* offsets of the entries in, sorted */
+	uint32_t strslen;	/* name NUL pathname NUL pairs */
+};
+
+struct hashfile_dir {
+	time_t mtime, ctime;
+};
+
+struct hashfile_new {
+	struct hashfile_new *next;
+	char *path;
+	char name[4];		/* enlarged as needed */
+};
+
+static const char hashfile_magic[8] = {
+	'm', 'k', 's', 'h', 'H', 'C', '1', (char)sizeof(time_t)
+};
+static char *hashfile_name;	/* HASHFILE, PATH the state is for */
+static char *hashfile_key;
+static struct hashfile_dir *hashfile_dirs;
+static uint32_t hashfile_ndirs;
+static time_t hashfile_checked;
+static bool hashfile_usable;
+static unsigned char *hashfile_map;
+static size_t hashfile_maplen;
+static const uint32_t *hashfile_idx;
+static const char *hashfile_strs;
+static uint32_t hashfile_nent, hashfile_strslen;
+static struct hashfile_new *hashfile_news;
+
+static bool hashfile_check(void);
+static bool hashfile_stamp(struct hashfile_dir *);
+static void hashfile_drop(bool);
+static void hashfile_load(void);
+static char *hashfile_get(const char *);
+static void hashfile_put(const char *, const char *);
+static int hashfile_cmp(const void *, const void *);
+#endif
+
 /*
  * execute command tree
  */
@@ -65,6 +153,8 @@ execute(struct op * volatile t,
 
 	if (t == NULL)
 		return (0);
+	/* anything may change from here on */
+	++exec_serial;
 
 	/* Caller doesn't care if XERROK should propagate. */
 	if (xerrok == NULL)
@@ -181,6 +271,8 @@ execute(struct op * volatile t,
 	case TPIPE:
 		flags |= XFORK;
 		flags &= ~XEXEC;
+		/* the last command writes to the real stdout */
+		comsub_spill();
 		e->savefd[0] = savefd(0);
 		e->savefd[1] = savefd(1);
 		while (t->type == TPIPE) {
@@ -205,6 +297,30 @@ execute(struct op * volatile t,
 		restfd(1, e->savefd[1]);
 		/* no need to re-restore this */
 		e->savefd[1] = 0;
+		if (Flag(FLASTPIPE) && !(flags & (XBGND | XXCOM)) &&
+#ifndef MKSH_UNEMPLOYED
+		    !Flag(FMONITOR) &&
+#endif
+		    lastpipe_here(t)) {
+			/* run the last command in this shell */
+			volatile int age = lastpipe_start();
+
+			e->type = E_ERRH;
+			if ((i = kshsetjmp(e->jbuf))) {
+				/* let the others see EOF or SIGPIPE */
+				restfd(0, e->savefd[0]);
+				e->savefd[0] = 0;
+				lastpipe_wait(age, 0);
+				quitenv(NULL);
+				unwind(i);
+				/* NOTREACHED */
+			}
+			rv = execute(t, flags & XERROK, xerrok);
+			restfd(0, e->savefd[0]);
+			e->savefd[0] = 0;
+			rv = lastpipe_wait(age, rv);
+			break;
+		}
 		/* Let exchild() close 0 in parent, after fork, before wait */
 		i = exchild(t, flags | XPCLOSE | XPIPEST, xerrok, 0);
 		if (!(flags&XBGND) && !(flags&XXCOM))
@@ -244,6 +360,7 @@ execute(struct op * volatile t,
 		coproc_cleanup(true);
 
 		/* do this before opening pipes, in case these fail */
+		comsub_spill();
 		e->savefd[0] = savefd(0);
 		e->savefd[1] = savefd(1);
 
@@ -316,6 +433,7 @@ execute(struct op * volatile t,
 		Test_env te;
 
 		te.flags = TEF_DBRACKET;
+		te.st_name = NULL;
 		te.pos.wp = t->args;
 		te.isa = dbteste_isa;
 		te.getopnd = dbteste_getopnd;
@@ -366,6 +484,12 @@ execute(struct op * volatile t,
 		break;
 	}
 
+	case TPFOR:
+		rv = execpfor(t, (t->vars == NULL) ? e->loc->argv + 1 :
+		    (const char **)eval((const char **)t->vars,
+		    DOBLANK | DOGLOB | DOTILDE));
+		break;
+
 	case TWHILE:
 	case TUNTIL:
 		e->type = E_LOOP;
@@ -445,6 +569,7 @@ execute(struct op * volatile t,
 		up = makenv();
 		restoresigs();
 		cleanup_proc_env();
+		bout_flush();
 		{
 			union mksh_ccphack cargs;
 
@@ -485,6 +610,46 @@ execute(struct op * volatile t,
 	return (rv);
 }
 
+/*
+ * lastpipe: whether the last command of a pipeline can run in the
+ * shell, i.e. is a compound command or a simple command known to be
+ * a built-in or function without expanding its name; anything else
+ * is forked anyway
+ */
+static bool
+lastpipe_here(struct op *t)
+{
+	const char *cp;
+	char *name;
+	struct tbl *tp;
+
+	switch (t->type) {
+	case TCOM:
+		if ((cp = t->args[0]) == NULL)
+			/* assignments only */
+			return (true);
+		while (*cp == CHAR)
+			cp += 2;
+		if (*cp != EOS)
+			return (false);
+		name = wdstrip(t->args[0], 0);
+		tp = findcom(name, FC_BI | FC_FUNC);
+		afree(name, ATEMP);
+		return (tp != NULL);
+	case TBRACE:
+	case TCASE:
+	case TDBRACKET:
+	case TFOR:
+	case TIF:
+	case TPFOR:
+	case TSELECT:
+	case TUNTIL:
+	case TWHILE:
+		return (true);
+	}
+	return (false);
+}
+
 /*
  * execute simple command
  */
@@ -537,8 +702,11 @@ comexec(struct op *t, struct tbl * volatile tp, const char **ap,
 		/* undo effects of command */
 		fcflags = FC_BI|FC_FUNC|FC_PATH;
 		if (tp->val.f == c_builtin) {
-			if ((cp = *++ap) == NULL ||
-			    (!strcmp(cp, "--") && (cp = *++ap) == NULL)) {
+			ksh_getopt_reset(&builtin_opt, 0);
+			if (ksh_getopt(ap, &builtin_opt, ":f:") != EOF)
+				/* builtin -f file name ..., see c_builtin() */
+				break;
+			if ((cp = *(ap += builtin_opt.optind)) == NULL) {
 				tp = NULL;
 				break;
 			}
@@ -604,6 +772,9 @@ comexec(struct op *t, struct tbl * volatile tp, const char **ap,
 				/* go on, use the builtin */
 				break;
 #endif
+		} else if (builtin_external(tp->val.f, ap)) {
+			/* options etc. only the external utility knows */
+			fcflags = FC_PATH;
 		} else if (tp->val.f == c_trap) {
 			t->u.evalflags &= ~DOTCOMEXEC;
 			break;
@@ -1080,6 +1251,9 @@ findcom(const char *name, int flags)
 	/* for function autoloading */
 	char *fpath;
 	union mksh_cchack npath;
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+	bool hashed;
+#endif
 
 	if (vstrchr(name, '/')) {
 		insert = 0;
@@ -1133,10 +1307,22 @@ findcom(const char *name, int flags)
 			/* make ~ISSET */
 			tp->flag = DEFINED;
 		}
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+		hashed = !(flags & FC_DEFPATH) && !vstrchr(name, '/') &&
+		    hashfile_check();
+		if (hashed && (npath.rw = hashfile_get(name)) != NULL)
+			/* nothing new */
+			hashed = false;
+		else
+#endif
 		npath.ro = search_path(name,
 		    (flags & FC_DEFPATH) ? def_path : path,
 		    X_OK, &tp->u2.errnov);
 		if (npath.ro) {
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+			if (hashed && npath.ro != name)
+				hashfile_put(name, npath.ro);
+#endif
 			strdupx(tp->val.s, npath.ro, APERM);
 			if (npath.ro != name)
 				afree(npath.rw, ATEMP);
@@ -1181,6 +1367,445 @@ flushcom(bool all)
 		}
 }
 
+#ifndef MKSH_SMALL
+/* find, create and validate the cache for the directory dir[0..len) */
+static struct pathdir *
+pathdir_get(const char *dir, size_t len)
+{
+	struct pathdir *pd;
+	struct stat sb;
+	time_t now;
+
+	if (len == 0 || *dir != '/')
+		/* relative to the current directory, not cached */
+		return (NULL);
+	for (pd = pathdirs; pd != NULL; pd = pd->next)
+		if (!strncmp(pd->dir, dir, len) && pd->dir[len] == '\0')
+			break;
+	if (pd == NULL) {
+		pd = alloc(offsetof(struct pathdir, dir[0]) + len + 1, APERM);
+		memset(pd, 0, offsetof(struct pathdir, dir[0]));
+		memcpy(pd->dir, dir, len);
+		pd->dir[len] = '\0';
+		pd->next = pathdirs;
+		pathdirs = pd;
+	}
+	if (pd->names == NULL && pd->uses < 8 && ++pd->uses < 8)
+		return (NULL);
+	if (pd->checked == (now = time(NULL)))
+		return (pd);
+	pd->checked = now;
+	if (stat(pd->dir, &sb) < 0) {
+		if (pd->names != NULL) {
+			afree(pd->names, APERM);
+			pd->names = NULL;
+		}
+		return (pd);
+	}
+	if (pd->names == NULL || sb.st_mtime != pd->mtime ||
+	    sb.st_ctime != pd->ctime ||
+	    /* changed within the second of the last scan? */
+	    pd->mtime >= now - 1) {
+		pd->mtime = sb.st_mtime;
+		pd->ctime = sb.st_ctime;
+		pathdir_scan(pd);
+	}
+	return (pd);
+}
+
+/* read the names in the directory of pd */
+static void
+pathdir_scan(struct pathdir *pd)
+{
+	DIR *dirp;
+	struct dirent *d;
+	XString xs;
+	char *xp, *cp;
+	size_t n = 0, len, i;
+
+	if (pd->names != NULL) {
+		afree(pd->names, APERM);
+		pd->names = NULL;
+	}
+	if ((dirp = opendir(pd->dir)) == NULL)
+		return;
+	Xinit(xs, xp, 4096, ATEMP);
+	while ((d = readdir(dirp)) != NULL) {
+		if (d->d_name[0] == '.' && (d->d_name[1] == '\0' ||
+		    (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+			continue;
+		len = strlen(d->d_name) + 1;
+		XcheckN(xs, xp, len);
+		memcpy(xp, d->d_name, len);
+		xp += len;
+		++n;
+	}
+	closedir(dirp);
+
+	/* one block: the pointers, then the strings */
+	len = Xlength(xs, xp);
+	pd->names = alloc(n * sizeof(char *) + len + 1, APERM);
+	cp = (char *)(pd->names + n);
+	memcpy(cp, Xstring(xs, xp), len);
+	Xfree(xs, xp);
+	for (i = 0; i < n; ++i) {
+		pd->names[i] = cp;
+		cp += strlen(cp) + 1;
+	}
+	qsort(pd->names, n, sizeof(char *), xstrcmp);
+	pd->nnames = n;
+}
+
+/* 1 if name is in the cache of pd, 0 if not, -1 if that is unknown */
+static int
+pathdir_has(struct pathdir *pd, const char *name)
+{
+	if (pd == NULL || pd->names == NULL)
+		return (-1);
+	return (bsearch(&name, pd->names, pd->nnames, sizeof(char *),
+	    xstrcmp) != NULL);
+}
+#endif
+
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+/* whether the hash file may be used for the current PATH */
+static bool
+hashfile_check(void)
+{
+	const char *fn = str_val(global("HASHFILE"));
+	const char *sp;
+	struct hashfile_dir *dirs;
+	time_t now;
+
+	if (*fn != '/') {
+		if (hashfile_name != NULL) {
+			hashfile_drop(true);
+			afree(hashfile_name, APERM);
+			hashfile_name = NULL;
+		}
+		return (false);
+	}
+	if (hashfile_name == NULL || strcmp(hashfile_name, fn) ||
+	    strcmp(hashfile_key, path)) {
+		/* start over for another file or PATH */
+		hashfile_drop(true);
+		afree(hashfile_name, APERM);
+		strdupx(hashfile_name, fn, APERM);
+		afree(hashfile_key, APERM);
+		strdupx(hashfile_key, path, APERM);
+		afree(hashfile_dirs, APERM);
+		hashfile_dirs = NULL;
+		hashfile_ndirs = 0;
+		hashfile_checked = 0;
+		/* only absolute directories, so it is independent of $PWD */
+		sp = path;
+		do {
+			if (*sp != '/')
+				return (hashfile_usable = false);
+			++hashfile_ndirs;
+		} while ((sp = cstrchr(sp, ':')) != NULL && *++sp);
+		if (sp != NULL)
+			/* trailing colon, the current directory */
+			return (hashfile_usable = false);
+		hashfile_dirs = alloc2(hashfile_ndirs,
+		    sizeof(struct hashfile_dir), APERM);
+		memset(hashfile_dirs, 0,
+		    hashfile_ndirs * sizeof(struct hashfile_dir));
+	} else if (hashfile_dirs == NULL)
+		/* unusable PATH */
+		return (false);
+
+	if (hashfile_checked == (now = time(NULL)))
+		return (hashfile_usable);
+	hashfile_checked = now;
+	dirs = alloc2(hashfile_ndirs, sizeof(struct hashfile_dir), ATEMP);
+	if (!hashfile_stamp(dirs)) {
+		/* a directory may still be changing, skip for now */
+		hashfile_drop(true);
+		hashfile_usable = false;
+	} else {
+		if (memcmp(dirs, hashfile_dirs,
+		    hashfile_ndirs * sizeof(struct hashfile_dir))) {
+			/* found under other directory contents */
+			hashfile_drop(true);
+			memcpy(hashfile_dirs, dirs,
+			    hashfile_ndirs * sizeof(struct hashfile_dir));
+		}
+		hashfile_usable = true;
+		if (hashfile_map == NULL)
+			hashfile_load();
+	}
+	afree(dirs, ATEMP);
+	return (hashfile_usable);
+}
+
+/* get the times of the PATH directories; false if one just changed */
+static bool
+hashfile_stamp(struct hashfile_dir *dirs)
+{
+	const char *sp = hashfile_key, *p;
+	char *dir;
+	struct stat sb;
+	time_t now = time(NULL);
+	bool rv = true;
+
+	memset(dirs, 0, hashfile_ndirs * sizeof(struct hashfile_dir));
+	while (*sp) {
+		if ((p = cstrchr(sp, ':')) == NULL)
+			p = sp + strlen(sp);
+		strndupx(dir, sp, p - sp, ATEMP);
+		/* a missing directory keeps the zero times */
+		if (stat(dir, &sb) >= 0) {
+			dirs->mtime = sb.st_mtime;
+			dirs->ctime = sb.st_ctime;
+			if (sb.st_mtime >= now - 1)
+				rv = false;
+		}
+		afree(dir, ATEMP);
+		++dirs;
+		sp = *p ? p + 1 : p;
+	}
+	return (rv);
+}
+
+/* forget the mapped file and, if all, the commands found since */
+static void
+hashfile_drop(bool all)
+{
+	struct hashfile_new *hn;
+
+	if (hashfile_map != NULL) {
+		munmap(caddr_cast(hashfile_map), hashfile_maplen);
+		hashfile_map = NULL;
+	}
+	hashfile_nent = 0;
+	while (all && (hn = hashfile_news) != NULL) {
+		hashfile_news = hn->next;
+		afree(hn, APERM);
+	}
+}
+
+/* map the hash file if it matches the current state */
+static void
+hashfile_load(void)
+{
+	const struct hashfile_hdr *hdr;
+	struct stat sb;
+	size_t len, keylen;
+	int fd;
+
+	if ((fd = open(hashfile_name, O_RDONLY | O_BINARY)) < 0)
+		return;
+	if (fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode) ||
+	    /* someone else could make us run anything */
+	    sb.st_uid != geteuid() || (sb.st_mode & (S_IWGRP | S_IWOTH)) ||
+	    (size_t)sb.st_size < sizeof(struct hashfile_hdr) ||
+	    (off_t)(len = (size_t)sb.st_size) != sb.st_size)
+		goto hashfile_load_out;
+	hashfile_map = (void *)mmap(NULL, len, PROT_READ,
+	    MAP_FILE | MAP_PRIVATE, fd, (off_t)0);
+	if (hashfile_map == (unsigned char *)MAP_FAILED) {
+		hashfile_map = NULL;
+		goto hashfile_load_out;
+	}
+	hashfile_maplen = len;
+	hdr = (const void *)hashfile_map;
+	keylen = (strlen(hashfile_key) + 4) & ~(size_t)3;
+	if (memcmp(hdr->magic, hashfile_magic, sizeof(hashfile_magic)) ||
+	    hdr->ndirs != hashfile_ndirs || hdr->keylen != keylen ||
+	    hdr->strslen == 0 || len != sizeof(struct hashfile_hdr) +
+	    hashfile_ndirs * sizeof(struct hashfile_dir) + keylen +
+	    (size_t)hdr->nent * sizeof(uint32_t) + hdr->strslen)
+		goto hashfile_load_bad;
+	len = sizeof(struct hashfile_hdr);
+	if (memcmp(hashfile_map + len, hashfile_dirs,
+	    hashfile_ndirs * sizeof(struct hashfile_dir)))
+		goto hashfile_load_bad;
+	len += hashfile_ndirs * sizeof(struct hashfile_dir);
+	if (strcmp((const char *)hashfile_map + len, hashfile_key))
+		goto hashfile_load_bad;
+	len += keylen;
+	hashfile_idx = (const void *)(hashfile_map + len);
+	hashfile_strs = (const char *)(hashfile_idx + hdr->nent);
+	hashfile_strslen = hdr->strslen;
+	if (hashfile_strs[hashfile_strslen - 1] != '\0')
+		goto hashfile_load_bad;
+	hashfile_nent = hdr->nent;
+	goto hashfile_load_out;
+
+ hashfile_load_bad:
+	hashfile_drop(false);
+ hashfile_load_out:
+	close(fd);
+}
+
+/* look name up in the hash file */
+static char *
+hashfile_get(const char *name)
+{
+	uint32_t lo = 0, hi = hashfile_nent, mid, ofs;
+	const char *cp;
+	char *rv;
+	int i;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((ofs = hashfile_idx[mid]) >= hashfile_strslen)
+			/* corrupt */
+			return (NULL);
+		cp = hashfile_strs + ofs;
+		if ((i = strcmp(name, cp)) == 0) {
+			ofs += strlen(cp) + 1;
+			if (ofs >= hashfile_strslen ||
+			    hashfile_strs[ofs] != '/' ||
+			    /* one check instead of searching the PATH */
+			    ksh_access(hashfile_strs + ofs, X_OK) != 0)
+				return (NULL);
+			strdupx(rv, hashfile_strs + ofs, ATEMP);
+			return (rv);
+		}
+		if (i < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return (NULL);
+}
+
+/* remember a command found by searching the PATH */
+static void
+hashfile_put(const char *name, const char *fn)
+{
+	struct hashfile_new *hn;
+	size_t len = strlen(name) + 1;
+
+	hn = alloc(offsetof(struct hashfile_new, name[0]) + len +
+	    strlen(fn) + 1, APERM);
+	memcpy(hn->name, name, len);
+	hn->path = hn->name + len;
+	memcpy(hn->path, fn, strlen(fn) + 1);
+	hn->next = hashfile_news;
+	hashfile_news = hn;
+}
+
+/* sort by name; for the same name, the commands found since first */
+static int
+hashfile_cmp(const void *a, const void *b)
+{
+	const char * const *ea = a, * const *eb = b;
+	int i;
+
+	if ((i = strcmp(ea[0], eb[0])) == 0)
+		i = (eb[2] != NULL) - (ea[2] != NULL);
+	return (i);
+}
+
+/* write the hash file, if there is anything new, on exit */
+void
+hashfile_finish(void)
+{
+	struct hashfile_hdr hdr;
+	struct hashfile_new *hn;
+	struct hashfile_dir *dirs;
+	const char **ents;
+	uint32_t *idx;
+	XString xs;
+	char *xp, *tname;
+	struct {
+		const void *p;
+		size_t n;
+	} parts[6];
+	size_t n = 0, i, j, len;
+	int fd;
+
+	if (hashfile_news == NULL || !hashfile_usable)
+		return;
+	dirs = alloc2(hashfile_ndirs, sizeof(struct hashfile_dir), ATEMP);
+	if (!hashfile_stamp(dirs) || memcmp(dirs, hashfile_dirs,
+	    hashfile_ndirs * sizeof(struct hashfile_dir))) {
+		/* what we found may be outdated already */
+		afree(dirs, ATEMP);
+		return;
+	}
+
+	/* triples of name, pathname, whether found since */
+	i = hashfile_nent;
+	for (hn = hashfile_news; hn != NULL; hn = hn->next)
+		++i;
+	ents = alloc2(i, 3 * sizeof(char *), ATEMP);
+	for (hn = hashfile_news; hn != NULL; hn = hn->next) {
+		ents[3 * n + 0] = hn->name;
+		ents[3 * n + 1] = hn->path;
+		ents[3 * n + 2] = hn->name;
+		++n;
+	}
+	for (i = 0; i < hashfile_nent; ++i) {
+		if (hashfile_idx[i] >= hashfile_strslen)
+			continue;
+		ents[3 * n + 0] = hashfile_strs + hashfile_idx[i];
+		ents[3 * n + 1] = ents[3 * n + 0] +
+		    strlen(ents[3 * n + 0]) + 1;
+		ents[3 * n + 2] = NULL;
+		if (ents[3 * n + 1] < hashfile_strs + hashfile_strslen)
+			++n;
+	}
+	qsort(ents, n, 3 * sizeof(char *), hashfile_cmp);
+
+	/* the strings, keeping the first of each name */
+	idx = alloc2(n, sizeof(uint32_t), ATEMP);
+	Xinit(xs, xp, 1024, ATEMP);
+	for (i = j = 0; i < n; ++i) {
+		if (j && !strcmp(ents[3 * i], ents[3 * (i - 1)]))
+			continue;
+		idx[j++] = Xlength(xs, xp);
+		len = strlen(ents[3 * i]) + 1;
+		XcheckN(xs, xp, len);
+		memcpy(xp, ents[3 * i], len);
+		xp += len;
+		len = strlen(ents[3 * i + 1]) + 1;
+		XcheckN(xs, xp, len);
+		memcpy(xp, ents[3 * i + 1], len);
+		xp += len;
+	}
+
+	memcpy(hdr.magic, hashfile_magic, sizeof(hashfile_magic));
+	hdr.ndirs = hashfile_ndirs;
+	hdr.keylen = (strlen(hashfile_key) + 4) & ~(size_t)3;
+	hdr.nent = j;
+	hdr.strslen = Xlength(xs, xp);
+
+	/* write a private file next to it, then rename that over it */
+	tname = shf_smprintf("%s.%d", hashfile_name, (int)procpid);
+	if ((fd = open(tname, O_WRONLY | O_CREAT | O_EXCL |
+	    O_BINARY, 0600)) < 0)
+		goto hashfile_finish_out;
+	parts[0].p = &hdr;
+	parts[0].n = sizeof(hdr);
+	parts[1].p = hashfile_dirs;
+	parts[1].n = hashfile_ndirs * sizeof(struct hashfile_dir);
+	parts[2].p = hashfile_key;
+	parts[2].n = strlen(hashfile_key) + 1;
+	parts[3].p = "\0\0\0";
+	parts[3].n = hdr.keylen - parts[2].n;
+	parts[4].p = idx;
+	parts[4].n = hdr.nent * sizeof(uint32_t);
+	parts[5].p = Xstring(xs, xp);
+	parts[5].n = hdr.strslen;
+	for (i = 0; i < NELEM(parts); ++i)
+		if (write(fd, parts[i].p, parts[i].n) != (ssize_t)parts[i].n)
+			break;
+	if (close(fd) < 0 || i < NELEM(parts) ||
+	    rename(tname, hashfile_name) < 0)
+		unlink(tname);
+ hashfile_finish_out:
+	afree(tname, ATEMP);
+	Xfree(xs, xp);
+	afree(idx, ATEMP);
+	afree(ents, ATEMP);
+	afree(dirs, ATEMP);
+}
+#endif
+
 /* check if path is something we want to find */
 static int
 search_access(const char *fn, int mode)
@@ -1216,6 +1841,9 @@ search_path(const char *name, const char *lpath,
 	XString xs;
 	size_t namelen;
 	int ec = 0, ev;
+#ifndef MKSH_SMALL
+	bool cached = true;
+#endif
 
 	if (vstrchr(name, '/')) {
 		if ((ec = search_access(name, mode)) == 0) {
@@ -1230,11 +1858,24 @@ search_path(const char *name, const char *lpath,
 	namelen = strlen(name) + 1;
 	Xinit(xs, xp, 128, ATEMP);
 
+#ifndef MKSH_SMALL
+ search_path_again:
+#endif
 	sp = lpath;
 	while (sp != NULL) {
 		xp = Xstring(xs, xp);
 		if (!(p = cstrchr(sp, ':')))
 			p = sp + strlen(sp);
+#ifndef MKSH_SMALL
+		if (cached &&
+		    pathdir_has(pathdir_get(sp, p - sp), name) == 0) {
+			/* not there, skip it */
+			sp = p;
+			if (*sp++ == '\0')
+				sp = NULL;
+			continue;
+		}
+#endif
 		if (p != sp) {
 			XcheckN(xs, xp, p - sp);
 			memcpy(xp, sp, p - sp);
@@ -1254,6 +1895,14 @@ search_path(const char *name, const char *lpath,
 		if (*sp++ == '\0')
 			sp = NULL;
 	}
+#ifndef MKSH_SMALL
+	if (cached) {
+		/* the caches may be out of date, try without them */
+		cached = false;
+		ec = 0;
+		goto search_path_again;
+	}
+#endif
 	Xfree(xs, xp);
  search_path_err:
 	if (errnop)
@@ -1268,9 +1917,14 @@ call_builtin(struct tbl *tp, const char **wp, const char *where)
 
 	if (!tp)
 		internal_errorf("%s: %s", where, wp[0]);
+	if (tp->flag & LOADED_BI) {
+		/* not using shl_stdout: output goes to the real fd 1 */
+		comsub_spill();
+		bout_flush();
+	}
 	builtin_argv0 = wp[0];
 	builtin_flag = tp->flag;
-	shf_reopen(1, SHF_WR, shl_stdout);
+	shf_reopen(1, SHF_WR, &shf_iob[/* fd */ 1]);
 	shl_stdout_ok = true;
 	ksh_getopt_reset(&builtin_opt, GF_ERROR);
 	rv = (*tp->val.f)(wp);
@@ -1383,6 +2037,9 @@ iosetup(struct ioword *iop, struct tbl *tp)
 		}
 		return (-1);
 	}
+	/* redirections involving stdout need it to be a real fd */
+	if (iop->unit == 1 || (iotype == IODUP && u == 1))
+		comsub_spill();
 	/* Do not save if it has already been redirected (i.e. "cat >x >y"). */
 	if (e->savefd[iop->unit] == 0) {
 		/* If these are the same, it means unit was previously closed */
@@ -1399,6 +2056,8 @@ iosetup(struct ioword *iop, struct tbl *tp)
 			e->savefd[iop->unit] = savefd(iop->unit);
 	}
 
+	/* also if the file was opened as iop->unit itself */
+	bout_fdchange(iop->unit);
 	if (do_close)
 		close(iop->unit);
 	else if (u != iop->unit) {
@@ -1652,6 +2311,170 @@ pr_list(char * const *ap)
 	    aocts, acols, false);
 }
 
+/*
+ * parallel for loop: run the body for each word of ap in a worker
+ * subprocess, at most -P max of them at a time (the number of online
+ * CPUs if max is not positive); -s stores the exit statuses in an
+ * array, -o keeps the output of the workers in temporary files until
+ * it can be written in the order of the words
+ */
+struct pfor_item {
+	pid_t pid;
+	int fd;			/* temporary file with its output, or -1 */
+	int rv;			/* exit status, -1 while running */
+};
+
+static int
+execpfor(struct op *t, const char **ap)
+{
+	struct pfor_item * volatile it;
+	struct tbl * volatile vs = NULL;
+	volatile size_t nstart = 0, ndone = 0, nshown = 0;
+	volatile int ofd = 0;
+	size_t nitems, i;
+	mksh_ari_t max;
+	int rv = 0, sig, jr;
+	pid_t pid;
+
+	evaluate(evalstr(t->args[0], 0), &max, KSH_UNWIND_ERROR, true);
+	if (max <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		max = (mksh_ari_t)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (max <= 0)
+			max = 1;
+	}
+	if (t->args[1] != NULL) {
+		vs = global(evalstr(t->args[1], 0));
+		if (vs->flag & RDONLY)
+			errorf("read-only: %s", vs->name);
+		unset(vs, 1);
+	}
+	if (t->u.ordered) {
+		/* the output is copied here from the temporary files */
+		comsub_spill();
+		ofd = savefd(1);
+	}
+
+	nitems = 0;
+	while (ap[nitems] != NULL)
+		++nitems;
+	it = alloc2(nitems + 1, sizeof(struct pfor_item), ATEMP);
+
+	e->type = E_ERRH;
+	if ((jr = kshsetjmp(e->jbuf))) {
+		pfor_release();
+		while (nstart)
+			if (it[--nstart].fd >= 0)
+				close(it[nstart].fd);
+		if (t->u.ordered)
+			restfd(1, ofd);
+		quitenv(NULL);
+		unwind(jr);
+		/* NOTREACHED */
+	}
+
+	while (ndone < nitems) {
+		if (nstart < nitems && nstart - ndone < (size_t)max) {
+			setstr(global(t->str), ap[nstart], KSH_UNWIND_ERROR);
+			it[nstart].fd = -1;
+			it[nstart].rv = -1;
+			it[nstart].pid = 0;
+			if (t->u.ordered)
+				ksh_dup2((it[nstart].fd = pfor_temp()), 1,
+				    false);
+			++nstart;
+			it[nstart - 1].pid = exchild(t->left, XBGND | XPFOR,
+			    NULL, -1);
+			continue;
+		}
+		if ((rv = pfor_wait(&pid, &sig)) < 0)
+			/* interrupted, or the workers are gone */
+			break;
+		for (i = nshown; i < nstart; ++i)
+			if (it[i].rv < 0 && it[i].pid == pid)
+				break;
+		if (i == nstart)
+			continue;
+		it[i].rv = rv;
+		++ndone;
+		if (vs != NULL)
+			setint(arraysearch(vs, (uint32_t)i), rv);
+		while (nshown < nstart && it[nshown].rv >= 0) {
+			if (it[nshown].fd >= 0) {
+				pfor_show(it[nshown].fd, ofd);
+				close(it[nshown].fd);
+				it[nshown].fd = -1;
+			}
+			++nshown;
+		}
+	}
+
+	if (ndone < nitems) {
+		pfor_release();
+		while (nstart > nshown)
+			if (it[--nstart].fd >= 0)
+				close(it[nstart].fd);
+		rv = sig ? sig : 1;
+	} else
+		rv = nitems ? it[nitems - 1].rv : 0;
+	if (t->u.ordered)
+		restfd(1, ofd);
+	afree(it, ATEMP);
+	return (rv);
+}
+
+/* unlinked temporary file for the output of a parallel for worker */
+static int
+pfor_temp(void)
+{
+	struct temp *tf = NULL;
+	int fd, nfd;
+
+	maketemp(ATEMP, TT_FUNSUB, &tf);
+	if (!tf->shf)
+		errorf("can't %s temporary file %s: %s",
+		    "create", tf->tffn, cstrerror(errno));
+	fd = shf_fileno(tf->shf);
+	afree(tf->shf, ATEMP);
+	unlink(tf->tffn);
+	afree(tf, ATEMP);
+	/* keep it out of the way of the redirections in the body */
+	if ((nfd = savefd(fd)) != fd)
+		close(fd);
+	return (nfd);
+}
+
+/* copy the output of a parallel for worker from fd to ofd */
+static void
+pfor_show(int fd, int ofd)
+{
+	char buf[4096];
+	ssize_t n, w;
+	char *cp;
+
+	if (ofd < 0 || lseek(fd, (off_t)0, SEEK_SET) == (off_t)-1)
+		return;
+	bout_flush();
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		cp = buf;
+		while (n > 0) {
+			if ((w = write(ofd, cp, n)) < 0) {
+				if (errno == EINTR)
+					continue;
+				return;
+			}
+			cp += w;
+			n -= w;
+		}
+	}
+}
+
 /*
  *	[[ ... ]] evaluation routines
  */
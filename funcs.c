@@ -38,6 +38,14 @@
 #endif
 #endif
 
+#if HAVE_DLOPEN
+#include <dlfcn.h>
+#endif
+
+#if HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
 __RCSID("$MirOS: src/bin/mksh/funcs.c,v 1.254 2014/01/05 19:20:31 tg Exp $");
 
 #if HAVE_KILLPG
@@ -97,6 +105,7 @@ const struct builtin mkshbuiltins[] = {
 	{"[", c_test},
 	/* no =: AT&T manual wrong */
 	{Talias, c_alias},
+	{"basename", c_basename},
 	{"*=break", c_brkcont},
 	{Tgbuiltin, c_builtin},
 	{"cat", c_cat},
@@ -105,6 +114,7 @@ const struct builtin mkshbuiltins[] = {
 	{"chdir", c_cd},
 	{"command", c_command},
 	{"*=continue", c_brkcont},
+	{"dirname", c_dirname},
 	{"echo", c_print},
 	{"*=eval", c_eval},
 	{"*=exec", c_exec},
@@ -118,6 +128,7 @@ const struct builtin mkshbuiltins[] = {
 	{"kill", c_kill},
 	{"let", c_let},
 	{"let]", c_let},
+	{"mkdir", c_mkdir},
 	{"print", c_print},
 	{"pwd", c_pwd},
 	{"read", c_read},
@@ -154,6 +165,18 @@ const struct builtin mkshbuiltins[] = {
 #ifdef MKSH_PRINTF_BUILTIN
 	{"printf", c_printf},
 #endif
+#ifdef MKSH_HEAD_BUILTIN
+	{"head", c_head},
+#endif
+#ifdef MKSH_TAIL_BUILTIN
+	{"tail", c_tail},
+#endif
+#ifdef MKSH_TR_BUILTIN
+	{"tr", c_tr},
+#endif
+#ifdef MKSH_WC_BUILTIN
+	{"wc", c_wc},
+#endif
 #if HAVE_SELECT
 	{"sleep", c_sleep},
 #endif
@@ -284,6 +307,7 @@ c_print(const char **wp)
 	const char *s, *emsg;
 	XString xs;
 	char *xp;
+	struct shf *shf;
 
 	if (wp[0][0] == 'e') {
 		/* echo builtin */
@@ -444,10 +468,19 @@ c_print(const char **wp)
 		Xput(xs, xp, '\0');
 		histsave(&source->line, Xstring(xs, xp), true, false);
 		Xfree(xs, xp);
+	} else if (fd == 1 && shl_capture != NULL) {
+		/* stdout is captured in memory, see comsub() */
+		shf_write(Xstring(xs, xp), Xlength(xs, xp), shl_capture);
+	} else if ((coproc.write < 0 || coproc.write != fd) &&
+	    (shf = bout_get(fd)) != NULL) {
+		/* written out together with what follows, see shf.c */
+		if (shf_write(Xstring(xs, xp), Xlength(xs, xp), shf) == EOF)
+			return (1);
 	} else {
 		int len = Xlength(xs, xp);
 		int opipe = 0;
 
+		bout_flush();
 		/*
 		 * Ensure we aren't killed by a SIGPIPE while writing to
 		 * a coprocess. AT&T ksh doesn't seem to do this (seems
@@ -1599,6 +1632,85 @@ c_shift(const char **wp)
 	return (0);
 }
 
+/*
+ * apply the symbolic mode (as in chmod(1) or umask -S) in cp to the
+ * permission bits in *modep; false if it is malformed
+ */
+static bool
+symbolic_mode(const char *cp, mode_t *modep)
+{
+	int positions, new_val;
+	char op;
+	mode_t old_mode = *modep, new_mode = old_mode;
+
+	positions = 0;
+	while (*cp) {
+		while (*cp && vstrchr("augo", *cp))
+			switch (*cp++) {
+			case 'a':
+				positions |= 0111;
+				break;
+			case 'u':
+				positions |= 0100;
+				break;
+			case 'g':
+				positions |= 0010;
+				break;
+			case 'o':
+				positions |= 0001;
+				break;
+			}
+		if (!positions)
+			/* default is a */
+			positions = 0111;
+		if (!vstrchr("=+-", op = *cp))
+			break;
+		cp++;
+		new_val = 0;
+		while (*cp && vstrchr("rwxugoXs", *cp))
+			switch (*cp++) {
+			case 'r': new_val |= 04; break;
+			case 'w': new_val |= 02; break;
+			case 'x': new_val |= 01; break;
+			case 'u':
+				new_val |= old_mode >> 6;
+				break;
+			case 'g':
+				new_val |= old_mode >> 3;
+				break;
+			case 'o':
+				new_val |= old_mode >> 0;
+				break;
+			case 'X':
+				if (old_mode & 0111)
+					new_val |= 01;
+				break;
+			case 's':
+				/* ignored */
+				break;
+			}
+		new_val = (new_val & 07) * positions;
+		switch (op) {
+		case '-':
+			new_mode &= ~new_val;
+			break;
+		case '=':
+			new_mode = new_val |
+			    (new_mode & ~(positions * 07));
+			break;
+		case '+':
+			new_mode |= new_val;
+		}
+		if (*cp == ',') {
+			positions = 0;
+			cp++;
+		} else if (!vstrchr("=+-", *cp))
+			break;
+	}
+	*modep = new_mode;
+	return (*cp == '\0');
+}
+
 int
 c_umask(const char **wp)
 {
@@ -1649,79 +1761,11 @@ c_umask(const char **wp)
 			}
 		} else {
 			/* symbolic format */
-			int positions, new_val;
-			char op;
-
 			old_umask = umask((mode_t)0);
 			/* in case of error */
 			umask(old_umask);
-			old_umask = ~old_umask;
-			new_umask = old_umask;
-			positions = 0;
-			while (*cp) {
-				while (*cp && vstrchr("augo", *cp))
-					switch (*cp++) {
-					case 'a':
-						positions |= 0111;
-						break;
-					case 'u':
-						positions |= 0100;
-						break;
-					case 'g':
-						positions |= 0010;
-						break;
-					case 'o':
-						positions |= 0001;
-						break;
-					}
-				if (!positions)
-					/* default is a */
-					positions = 0111;
-				if (!vstrchr("=+-", op = *cp))
-					break;
-				cp++;
-				new_val = 0;
-				while (*cp && vstrchr("rwxugoXs", *cp))
-					switch (*cp++) {
-					case 'r': new_val |= 04; break;
-					case 'w': new_val |= 02; break;
-					case 'x': new_val |= 01; break;
-					case 'u':
-						new_val |= old_umask >> 6;
-						break;
-					case 'g':
-						new_val |= old_umask >> 3;
-						break;
-					case 'o':
-						new_val |= old_umask >> 0;
-						break;
-					case 'X':
-						if (old_umask & 0111)
-							new_val |= 01;
-						break;
-					case 's':
-						/* ignored */
-						break;
-					}
-				new_val = (new_val & 07) * positions;
-				switch (op) {
-				case '-':
-					new_umask &= ~new_val;
-					break;
-				case '=':
-					new_umask = new_val |
-					    (new_umask & ~(positions * 07));
-					break;
-				case '+':
-					new_umask |= new_val;
-				}
-				if (*cp == ',') {
-					positions = 0;
-					cp++;
-				} else if (!vstrchr("=+-", *cp))
-					break;
-			}
-			if (*cp) {
+			new_umask = ~old_umask;
+			if (!symbolic_mode(cp, &new_umask)) {
 				bi_errorf("bad mask");
 				return (1);
 			}
@@ -1772,12 +1816,31 @@ c_dot(const char **wp)
 int
 c_wait(const char **wp)
 {
-	int rv = 0, sig;
+	int rv = 0, sig, optc;
+	bool nextjob = false;
+	const char *pvar = NULL;
+	pid_t pid;
 
-	if (ksh_getopt(wp, &builtin_opt, null) == '?')
-		return (1);
+	while ((optc = ksh_getopt(wp, &builtin_opt, "np:")) != -1)
+		switch (optc) {
+		case 'n':
+			nextjob = true;
+			break;
+		case 'p':
+			pvar = builtin_opt.optarg;
+			break;
+		case '?':
+			return (1);
+		}
 	wp += builtin_opt.optind;
-	if (*wp == NULL) {
+	bout_flush();
+	if (nextjob) {
+		if ((rv = waitnext(*wp ? wp : NULL, &sig, &pid)) < 0)
+			/* magic exit code: nothing to wait for */
+			rv = sig ? sig : 127;
+		else if (pvar)
+			setint(global(pvar), (mksh_ari_t)pid);
+	} else if (*wp == NULL) {
 		while (waitfor(NULL, &sig) >= 0)
 			;
 		rv = sig;
@@ -1809,6 +1872,7 @@ c_read(const char **wp)
 	ptrdiff_t xsave = 0;
 	mksh_ttyst tios;
 	bool restore_tios = false;
+	struct stat sb;
 #if HAVE_SELECT
 	bool hastimeout = false;
 	struct timeval tv, tvlim;
@@ -1897,6 +1961,10 @@ c_read(const char **wp)
 		}
 	}
 
+	/* whoever writes our input may wait to see our output first */
+	if (fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode))
+		bout_flush();
+
 	Xinit(xs, xp, bytesleft, ATEMP);
 
 	if (readmode == LINES)
@@ -2660,6 +2728,78 @@ c_exec(const char **wp MKSH_A_UNUSED)
 	return (0);
 }
 
+/*
+ * builtin -f file name ... - load builtins from a shared object:
+ * the function int b_name(const char **wp), with any other character
+ * than letters and digits in name replaced by an underscore, becomes
+ * the builtin name; running builtins is taken care of in comexec()
+ */
+int
+c_builtin(const char **wp)
+{
+	const char *lib = NULL, *name;
+#if HAVE_DLOPEN
+	void *dh;
+	union {
+		void *p;
+		int (*f)(const char **);
+	} sym;
+	char *cp;
+#endif
+	int optc, rv = 0;
+
+	while ((optc = ksh_getopt(wp, &builtin_opt, "f:")) != -1)
+		switch (optc) {
+		case 'f':
+			lib = builtin_opt.optarg;
+			break;
+		case '?':
+			return (1);
+		}
+	wp += builtin_opt.optind;
+	if (lib == NULL || *wp == NULL) {
+		bi_errorf("%s: %s", "usage", "builtin -f file name ...");
+		return (1);
+	}
+	if (Flag(FRESTRICTED)) {
+		bi_errorf("%s: %s", lib, "restricted");
+		return (1);
+	}
+#if HAVE_DLOPEN
+	/* never closed, the builtins keep pointing into it */
+	if ((dh = dlopen(lib, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+		bi_errorf("%s", dlerror());
+		return (1);
+	}
+	while ((name = *wp++) != NULL) {
+		if (!*name || *name == '=' || *name == '*' ||
+		    vstrchr(name, '/')) {
+			bi_errorf("%s: %s", name, "invalid builtin name");
+			rv = 1;
+			continue;
+		}
+		cp = shf_smprintf("b_%s", name);
+		for (optc = 2; cp[optc]; ++optc)
+			if (!ksh_isalnux(cp[optc]))
+				cp[optc] = '_';
+		sym.p = dlsym(dh, cp);
+		afree(cp, ATEMP);
+		if (sym.p == NULL) {
+			bi_errorf("%s: %s", name, dlerror());
+			rv = 1;
+			continue;
+		}
+		name = builtin(name, sym.f);
+		ktsearch(&builtins, name, hash(name))->flag |= LOADED_BI;
+	}
+#else
+	name = *wp;
+	bi_errorf("%s: %s", name, "loading builtins not supported");
+	rv = 1;
+#endif
+	return (rv);
+}
+
 #if HAVE_MKNOD
 int
 c_mknod(const char **wp)
@@ -2780,6 +2920,7 @@ c_test(const char **wp)
 	const char *lhs, **swp;
 
 	te.flags = 0;
+	te.st_name = NULL;
 	te.isa = ptest_isa;
 	te.getopnd = ptest_getopnd;
 	te.eval = test_eval;
@@ -2906,6 +3047,65 @@ test_isop(Test_meta meta, const char *s)
 	return (TO_NONOP);
 }
 
+/*
+ * Chained file tests on the same pathname, like [[ -f $f && -r $f ]],
+ * share the result of each system call for the rest of the expression
+ * as long as no command (e.g. in a substitution) runs meanwhile.
+ */
+static void
+test_cache(Test_env *te, const char *path)
+{
+	if (te->st_name != NULL && te->st_serial == exec_serial &&
+	    !strcmp(te->st_name, path))
+		return;
+	afree(te->st_name, ATEMP);
+	strdupx(te->st_name, path, ATEMP);
+	te->st_rv[0] = te->st_rv[1] = 1;
+	te->st_serial = exec_serial;
+	te->acc_tried = te->acc_ok = 0;
+}
+
+static int
+test_stat(Test_env *te, const char *path, struct stat *sbp, bool link)
+{
+	if (te == NULL)
+		/* called from main_init() */
+		return (stat(path, sbp));
+	test_cache(te, path);
+	if (te->st_rv[link] == 1) {
+		if (link) {
+#ifndef MKSH__NO_SYMLINK
+			te->st_rv[1] = lstat(path, &te->st_buf[1]);
+			/* not a symlink: stat(2) would say the same */
+			if (te->st_rv[1] == 0 && te->st_rv[0] == 1 &&
+			    !S_ISLNK(te->st_buf[1].st_mode)) {
+				te->st_rv[0] = 0;
+				te->st_buf[0] = te->st_buf[1];
+			}
+#else
+			te->st_rv[1] = stat(path, &te->st_buf[1]);
+#endif
+		} else
+			te->st_rv[0] = stat(path, &te->st_buf[0]);
+	}
+	*sbp = te->st_buf[link];
+	return (te->st_rv[link]);
+}
+
+static int
+test_access(Test_env *te, const char *path, int mode)
+{
+	test_cache(te, path);
+	if (!(te->acc_tried & mode)) {
+		te->acc_tried |= mode;
+		/* LINTED use of access */
+		if ((mode == X_OK ? ksh_access(path, mode) :
+		    access(path, mode)) == 0)
+			te->acc_ok |= mode;
+	}
+	return ((te->acc_ok & mode) ? 0 : -1);
+}
+
 int
 test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
     bool do_eval)
@@ -2970,55 +3170,60 @@ test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
 
 	/* -r */
 	case TO_FILRD:
-		/* LINTED use of access */
-		return (access(opnd1, R_OK) == 0);
+		return (test_access(te, opnd1, R_OK) == 0);
 
 	/* -w */
 	case TO_FILWR:
-		/* LINTED use of access */
-		return (access(opnd1, W_OK) == 0);
+		return (test_access(te, opnd1, W_OK) == 0);
 
 	/* -x */
 	case TO_FILEX:
-		return (ksh_access(opnd1, X_OK) == 0);
+		return (test_access(te, opnd1, X_OK) == 0);
 
 	/* -a */
 	case TO_FILAXST:
 	/* -e */
 	case TO_FILEXST:
-		return (stat(opnd1, &b1) == 0);
+		return (test_stat(te, opnd1, &b1, false) == 0);
 
 	/* -r */
 	case TO_FILREG:
-		return (stat(opnd1, &b1) == 0 && S_ISREG(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    S_ISREG(b1.st_mode));
 
 	/* -d */
 	case TO_FILID:
-		return (stat(opnd1, &b1) == 0 && S_ISDIR(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    S_ISDIR(b1.st_mode));
 
 	/* -c */
 	case TO_FILCDEV:
-		return (stat(opnd1, &b1) == 0 && S_ISCHR(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    S_ISCHR(b1.st_mode));
 
 	/* -b */
 	case TO_FILBDEV:
-		return (stat(opnd1, &b1) == 0 && S_ISBLK(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    S_ISBLK(b1.st_mode));
 
 	/* -p */
 	case TO_FILFIFO:
-		return (stat(opnd1, &b1) == 0 && S_ISFIFO(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    S_ISFIFO(b1.st_mode));
 
 	/* -h or -L */
 	case TO_FILSYM:
 #ifdef MKSH__NO_SYMLINK
 		return (0);
 #else
-		return (lstat(opnd1, &b1) == 0 && S_ISLNK(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, true) == 0 &&
+		    S_ISLNK(b1.st_mode));
 #endif
 
 	/* -S */
 	case TO_FILSOCK:
-		return (stat(opnd1, &b1) == 0 && S_ISSOCK(b1.st_mode));
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    S_ISSOCK(b1.st_mode));
 
 	/* -H => HP context dependent files (directories) */
 	case TO_FILCDF:
@@ -3047,18 +3252,18 @@ test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
 
 	/* -u */
 	case TO_FILSETU:
-		return (stat(opnd1, &b1) == 0 &&
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
 		    (b1.st_mode & S_ISUID) == S_ISUID);
 
 	/* -g */
 	case TO_FILSETG:
-		return (stat(opnd1, &b1) == 0 &&
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
 		    (b1.st_mode & S_ISGID) == S_ISGID);
 
 	/* -k */
 	case TO_FILSTCK:
 #ifdef S_ISVTX
-		return (stat(opnd1, &b1) == 0 &&
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
 		    (b1.st_mode & S_ISVTX) == S_ISVTX);
 #else
 		return (0);
@@ -3066,7 +3271,8 @@ test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
 
 	/* -s */
 	case TO_FILGZ:
-		return (stat(opnd1, &b1) == 0 && (off_t)b1.st_size > (off_t)0);
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    (off_t)b1.st_size > (off_t)0);
 
 	/* -t */
 	case TO_FILTT:
@@ -3079,11 +3285,13 @@ test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
 
 	/* -O */
 	case TO_FILUID:
-		return (stat(opnd1, &b1) == 0 && (uid_t)b1.st_uid == ksheuid);
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    (uid_t)b1.st_uid == ksheuid);
 
 	/* -G */
 	case TO_FILGID:
-		return (stat(opnd1, &b1) == 0 && (gid_t)b1.st_gid == getegid());
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    (gid_t)b1.st_gid == getegid());
 
 	/*
 	 * Binary Operators
@@ -3152,8 +3360,8 @@ test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
 		 * ksh88/ksh93 succeed if file2 can't be stated
 		 * (subtly different from 'does not exist').
 		 */
-		return (stat(opnd1, &b1) == 0 &&
-		    (((s = stat(opnd2, &b2)) == 0 &&
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    (((s = test_stat(te, opnd2, &b2, false)) == 0 &&
 		    b1.st_mtime > b2.st_mtime) || s < 0));
 
 	/* -ot */
@@ -3162,13 +3370,14 @@ test_eval(Test_env *te, Test_op op, const char *opnd1, const char *opnd2,
 		 * ksh88/ksh93 succeed if file1 can't be stated
 		 * (subtly different from 'does not exist').
 		 */
-		return (stat(opnd2, &b2) == 0 &&
-		    (((s = stat(opnd1, &b1)) == 0 &&
+		return (test_stat(te, opnd2, &b2, false) == 0 &&
+		    (((s = test_stat(te, opnd1, &b1, false)) == 0 &&
 		    b1.st_mtime < b2.st_mtime) || s < 0));
 
 	/* -ef */
 	case TO_FILEQ:
-		return (stat (opnd1, &b1) == 0 && stat (opnd2, &b2) == 0 &&
+		return (test_stat(te, opnd1, &b1, false) == 0 &&
+		    test_stat(te, opnd2, &b2, false) == 0 &&
 		    b1.st_dev == b2.st_dev && b1.st_ino == b2.st_ino);
 
 	/* all other cases */
@@ -3577,14 +3786,337 @@ c_realpath(const char **wp)
 	return (rv);
 }
 
+/* basename(1) of s, without suffix unless that is all there is */
+static void
+basename_show(const char *s, const char *suffix)
+{
+	size_t len = strlen(s), slen, start;
+
+	/* strip trailing slashes, but keep a lone one */
+	while (len > 1 && s[len - 1] == '/')
+		--len;
+	start = len;
+	while (start > 0 && s[start - 1] != '/')
+		--start;
+	if (start == len && len > 0)
+		/* only slashes */
+		--start;
+	else if (suffix != NULL && (slen = strlen(suffix)) > 0 &&
+	    slen < len - start && !memcmp(s + len - slen, suffix, slen))
+		len -= slen;
+	shf_write(s + start, len - start, shl_stdout);
+	shf_putc('\n', shl_stdout);
+}
+
+/*
+ * true if the builtin f, standing in for a utility, is given options
+ * only that knows; comexec() then runs the external utility instead
+ */
+bool
+builtin_external(int (*f)(const char **), const char **ap)
+{
+	const char *opts;
+	Getopt go;
+	int optc;
+
+	if (f == c_basename)
+		opts = ":as:";
+	else if (f == c_dirname)
+		opts = ":";
+	else if (f == c_mkdir)
+		opts = ":m:p";
+	else
+#ifdef MKSH_TEXT_BUILTINS
+		return (textutil_external(f, ap));
+#else
+		return (false);
+#endif
+	ksh_getopt_reset(&go, 0);
+	while ((optc = ksh_getopt(ap, &go, opts)) != -1)
+		if (optc == '?')
+			return (true);
+	return (false);
+}
+
+int
+c_basename(const char **wp)
+{
+	const char *suffix = NULL;
+	bool all = false;
+	int optc;
+
+	/* -a and -s are not in POSIX but common */
+	while ((optc = ksh_getopt(wp, &builtin_opt, "as:")) != -1)
+		switch (optc) {
+		case 's':
+			suffix = builtin_opt.optarg;
+			/* FALLTHROUGH */
+		case 'a':
+			all = true;
+			break;
+		case '?':
+			return (1);
+		}
+	wp += builtin_opt.optind;
+
+	if (wp[0] == NULL || (!all && wp[1] != NULL && wp[2] != NULL)) {
+		bi_errorf(Tsynerr);
+		return (1);
+	}
+	if (!all) {
+		basename_show(wp[0], wp[1]);
+		return (0);
+	}
+	while (*wp)
+		basename_show(*wp++, suffix);
+	return (0);
+}
+
+int
+c_dirname(const char **wp)
+{
+	const char *s;
+	size_t len;
+
+	if (ksh_getopt(wp, &builtin_opt, null) == '?')
+		return (1);
+	wp += builtin_opt.optind;
+	if (wp[0] == NULL) {
+		bi_errorf(Tsynerr);
+		return (1);
+	}
+
+	/* POSIX allows several operands as extension */
+	while ((s = *wp++) != NULL) {
+		len = strlen(s);
+		while (len > 1 && s[len - 1] == '/')
+			--len;
+		while (len > 0 && s[len - 1] != '/')
+			--len;
+		while (len > 1 && s[len - 1] == '/')
+			--len;
+		if (len == 0) {
+			s = ".";
+			len = 1;
+		}
+		shf_write(s, len, shl_stdout);
+		shf_putc('\n', shl_stdout);
+	}
+	return (0);
+}
+
+static bool
+is_dir(const char *s)
+{
+	struct stat sb;
+
+	return (stat(s, &sb) == 0 && S_ISDIR(sb.st_mode));
+}
+
+/*
+ * mkdir -p: make the missing parents of dir, with u+wx as POSIX says;
+ * returns 0 or an errno value, with dir cut after the failing one
+ */
+static int
+mkdir_parents(char *dir, mode_t um)
+{
+	char *sp = dir, *cp;
+	int eno;
+
+	while ((sp = strchr(sp + 1, '/')) != NULL) {
+		cp = sp;
+		while (*cp == '/')
+			++cp;
+		if (*cp == '\0')
+			/* trailing slashes */
+			break;
+		*sp = '\0';
+		if (mkdir(dir, 0777) == 0) {
+			if ((um & 0300) && chmod(dir, (0777 & ~um) | 0300))
+				return (errno);
+		} else {
+			eno = errno;
+			if (!is_dir(dir))
+				return (eno);
+		}
+		*sp = '/';
+		sp = cp - 1;
+	}
+	return (0);
+}
+
+int
+c_mkdir(const char **wp)
+{
+	int optc, rv = 0, eno;
+	bool parents = false;
+	const char *smode = NULL, *cp;
+	char *dir;
+	mode_t mode = 0777, um;
+
+	while ((optc = ksh_getopt(wp, &builtin_opt, "m:p")) != -1)
+		switch (optc) {
+		case 'm':
+			smode = builtin_opt.optarg;
+			break;
+		case 'p':
+			parents = true;
+			break;
+		case '?':
+			return (1);
+		}
+	wp += builtin_opt.optind;
+	if (wp[0] == NULL) {
+		bi_errorf(Tsynerr);
+		return (1);
+	}
+
+	if ((cp = smode) != NULL) {
+		/* symbolic modes are relative to a=rwx */
+		if (ksh_isdigit(*cp))
+			for (mode = 0; *cp >= '0' && *cp <= '7' &&
+			    mode <= 0777; cp++)
+				mode = mode * 8 + (*cp - '0');
+		if (mode > 07777 || (cp == smode ?
+		    !symbolic_mode(cp, &mode) : *cp != '\0')) {
+			bi_errorf("%s: %s", smode, "bad mode");
+			return (1);
+		}
+	}
+	um = umask((mode_t)0);
+	umask(um);
+
+	for (; *wp != NULL; ++wp) {
+		if (parents) {
+			strdupx(dir, *wp, ATEMP);
+			if ((eno = mkdir_parents(dir, um)) != 0) {
+				bi_errorf("%s: %s", dir, cstrerror(eno));
+				rv = 1;
+			}
+			afree(dir, ATEMP);
+			if (eno)
+				continue;
+		}
+		if (mkdir(*wp, mode) == 0) {
+			/* the umask only applies without -m */
+			if (smode == NULL || chmod(*wp, mode) == 0)
+				continue;
+		} else if (parents && errno == EEXIST && is_dir(*wp))
+			continue;
+		eno = errno;
+		bi_errorf("%s: %s", *wp, cstrerror(eno));
+		rv = 1;
+	}
+	return (rv);
+}
+
+#if HAVE_COPY_FILE_RANGE || HAVE_SENDFILE || HAVE_SPLICE
+#define MKSH_CAT_FAST
+/* bytes moved per system call, between checks for ^C */
+#define MKSH_CAT_CHUNK	(1048576)
+#define CAT_NONE	0
+#define CAT_CFR		1	/* copy_file_range(2): file to file */
+#define CAT_SENDFILE	2	/* sendfile(2): file to anything */
+#define CAT_SPLICE	3	/* splice(2): to or from a pipe */
+
+/*
+ * copy fd to stdout inside the kernel if both ends permit it; returns
+ * false if nothing (more) can be done that way and the caller has to
+ * go on with read(2) and write(2) from the current offsets instead
+ */
+static bool
+cat_fast(int fd, const char *fn, int *rvp)
+{
+	struct stat isb, osb;
+	ssize_t n;
+	int how, eno;
+
+	if (fstat(fd, &isb) || fstat(STDOUT_FILENO, &osb))
+		return (false);
+	/* empty regular files may be pseudo-files, e.g. in /proc */
+	if (S_ISREG(isb.st_mode) && isb.st_size > 0)
+		how = S_ISREG(osb.st_mode) ? CAT_CFR : CAT_SENDFILE;
+	else if (S_ISFIFO(isb.st_mode) || S_ISFIFO(osb.st_mode))
+		how = CAT_SPLICE;
+	else
+		return (false);
+
+	while (/* CONSTCOND */ 1) {
+		switch (how) {
+#if HAVE_COPY_FILE_RANGE
+		case CAT_CFR:
+			n = copy_file_range(fd, NULL, STDOUT_FILENO, NULL,
+			    MKSH_CAT_CHUNK, 0);
+			break;
+#endif
+#if HAVE_SENDFILE
+		case CAT_SENDFILE:
+			n = sendfile(STDOUT_FILENO, fd, NULL, MKSH_CAT_CHUNK);
+			break;
+#endif
+#if HAVE_SPLICE
+		case CAT_SPLICE:
+			n = splice(fd, NULL, STDOUT_FILENO, NULL,
+			    MKSH_CAT_CHUNK, SPLICE_F_MOVE);
+			break;
+#endif
+		default:
+			n = -1;
+			errno = ENOSYS;
+			break;
+		}
+		eno = errno;
+		/* give the user a chance to ^C out */
+		intrcheck();
+		if (n > 0)
+			continue;
+		if (n == 0)
+			/* end of file reached */
+			return (true);
+		switch (eno) {
+		case EINTR:
+			/* interrupted, try again */
+			continue;
+		case EINVAL:
+		case ENOSYS:
+		case EXDEV:
+		case EBADF:
+#ifdef EOPNOTSUPP
+		case EOPNOTSUPP:
+#endif
+#if defined(ENOTSUP) && (!defined(EOPNOTSUPP) || ENOTSUP != EOPNOTSUPP)
+		case ENOTSUP:
+#endif
+			/* not for this pair of files, try the next way */
+			if (how == CAT_CFR)
+				how = CAT_SENDFILE;
+			else if (how == CAT_SENDFILE &&
+			    S_ISFIFO(osb.st_mode))
+				how = CAT_SPLICE;
+			else
+				return (false);
+			continue;
+		}
+		/* we cannot tell which end failed; guess */
+		bi_errorf("%s: %s", eno == EPIPE || eno == ENOSPC ?
+		    "<stdout>" : fn, cstrerror(eno));
+		*rvp = 1;
+		return (true);
+	}
+}
+#endif
+
 int
 c_cat(const char **wp)
 {
 	int fd = STDIN_FILENO, rv, eno;
 	ssize_t n, w;
+	size_t bufsz;
 	const char *fn = "<stdin>";
 	char *buf, *cp;
+/* initial size, grown while reads fill the buffer completely */
 #define MKSH_CAT_BUFSIZ 4096
+#define MKSH_CAT_BUFMAX 131072
 
 	/* parse options: POSIX demands we support "-u" as no-op */
 	while ((rv = ksh_getopt(wp, &builtin_opt, "u")) != -1) {
@@ -3599,9 +4131,10 @@ c_cat(const char **wp)
 	}
 	wp += builtin_opt.optind;
 	rv = 0;
+	bout_flush();
 
-	if ((buf = malloc_osfunc(MKSH_CAT_BUFSIZ)) == NULL) {
-		bi_errorf(Toomem, (size_t)MKSH_CAT_BUFSIZ);
+	if ((buf = malloc_osfunc((bufsz = MKSH_CAT_BUFSIZ))) == NULL) {
+		bi_errorf(Toomem, bufsz);
 		return (1);
 	}
 
@@ -3617,8 +4150,13 @@ c_cat(const char **wp)
 				continue;
 			}
 		}
+#ifdef MKSH_CAT_FAST
+		/* stdout captured in memory (see comsub()) needs a copy */
+		if (shl_capture == NULL && cat_fast(fd, fn, &rv))
+			goto next;
+#endif
 		while (/* CONSTCOND */ 1) {
-			n = blocking_read(fd, (cp = buf), MKSH_CAT_BUFSIZ);
+			n = blocking_read(fd, buf, bufsz);
 			eno = errno;
 			/* give the user a chance to ^C out */
 			intrcheck();
@@ -3634,6 +4172,18 @@ c_cat(const char **wp)
 			} else if (n == 0)
 				/* end of file reached */
 				break;
+			else if ((size_t)n == bufsz && bufsz < MKSH_CAT_BUFMAX &&
+			    (cp = realloc_osfunc(buf, bufsz << 1)) != NULL) {
+				/* the input keeps up, use a larger buffer */
+				buf = cp;
+				bufsz <<= 1;
+			}
+			cp = buf;
+			if (shl_capture != NULL) {
+				/* stdout is captured in memory, see comsub() */
+				shf_write(cp, n, shl_capture);
+				continue;
+			}
 			while (n) {
 				w = write(STDOUT_FILENO, cp, n);
 				if (w == -1) {
@@ -3653,6 +4203,9 @@ c_cat(const char **wp)
 				cp += w;
 			}
 		}
+#ifdef MKSH_CAT_FAST
+ next:
+#endif
 		if (fd != STDIN_FILENO)
 			close(fd);
 	} while (*wp);
@@ -3701,6 +4254,7 @@ c_sleep(const char **wp)
 #endif
 		sigprocmask(SIG_BLOCK, &bmask, &omask);
 #endif
+		bout_flush();
 		if (select(1, NULL, NULL, NULL, &tv) == 0 || errno == EINTR)
 			/*
 			 * strictly speaking only for SIGALRM, but the
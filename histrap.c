@@ -46,23 +46,6 @@ static bool hstarted;		/* set after hist_init() called */
 static Source *hist_source;
 
 #if HAVE_PERSISTENT_HISTORY
-/*XXX imake style */
-#if defined(__linux)
-#define caddr_cast(x)	((void *)(x))
-#else
-#define caddr_cast(x)	((caddr_t)(x))
-#endif
-
-/* several OEs do not have these constants */
-#ifndef MAP_FAILED
-#define MAP_FAILED	caddr_cast(-1)
-#endif
-
-/* some OEs need the default mapping type specified */
-#ifndef MAP_FILE
-#define MAP_FILE	0
-#endif
-
 /* current history file: name, fd, size */
 static char *hname;
 static int histfd = -1;
@@ -1337,6 +1320,8 @@ settrap(Trap *p, const char *s)
 		return;
 	}
 
+	/* print output held for a pipe may depend on this signal */
+	bout_trap();
 	/* todo: should we let user know signal is ignored? how? */
 	setsig(p, f, SS_RESTORE_CURR|SS_USER);
 }
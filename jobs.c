@@ -22,6 +22,9 @@
  */
 
 #include "sh.h"
+#if HAVE_SIGNALFD && !defined(MKSH_NOPROSPECTOFWORK)
+#include <sys/signalfd.h>
+#endif
 
 __RCSID("$MirOS: src/bin/mksh/jobs.c,v 1.103 2013/11/30 17:41:35 tg Exp $");
 
@@ -38,15 +41,18 @@ __RCSID("$MirOS: src/bin/mksh/jobs.c,v 1.103 2013/11/30 17:41:35 tg Exp $");
 #define PSIGNALLED	2
 #define PSTOPPED	3
 
+typedef struct job Job;
 typedef struct proc Proc;
 struct proc {
 	Proc *next;		/* next process in pipeline (if any) */
+	Proc *hnext;		/* next process in the same proc_hash[] slot */
+	Job *job;		/* job this process belongs to */
 	pid_t pid;		/* process id */
 	int state;
 	int status;		/* wait status */
 	/* process command string from vistree */
-	char command[256 - (ALLOC_SIZE + sizeof(Proc *) + sizeof(pid_t) +
-	    2 * sizeof(int))];
+	char command[256 - (ALLOC_SIZE + 2 * sizeof(Proc *) + sizeof(Job *) +
+	    sizeof(pid_t) + 2 * sizeof(int))];
 };
 
 /* Notify/print flag - j_print() argument */
@@ -72,8 +78,10 @@ struct proc {
 #define JF_REMOVE	0x200	/* flagged for removal (j_jobs()/j_noityf()) */
 #define JF_USETTYMODE	0x400	/* tty mode saved if process exits normally */
 #define JF_SAVEDTTYPGRP	0x800	/* j->saved_ttypgrp is valid */
+#define JF_WAITSEL	0x1000	/* selected for wait -n */
+#define JF_WAITNEXT	0x2000	/* JF_WAITING set by waitnext() */
+#define JF_PFOR		0x4000	/* parallel for worker, see pfor_wait() */
 
-typedef struct job Job;
 struct job {
 	Job *next;		/* next job in list */
 	Proc *proc_list;	/* process list */
@@ -100,6 +108,7 @@ struct job {
 #define JW_ASYNCNOTIFY	0x02	/* asynchronous notification during wait ok */
 #define JW_STOPPEDWAIT	0x04	/* wait even if job stopped */
 #define JW_PIPEST	0x08	/* want PIPESTATUS */
+#define JW_LASTPIPE	0x10	/* last command ran in the shell, lastpipe_rv */
 
 /* Error codes for j_lookup() */
 #define JL_NOSUCH	0	/* no such job */
@@ -119,6 +128,19 @@ static pid_t async_pid;
 
 static int nzombie;		/* # of zombies owned by this process */
 static int32_t njobs;		/* # of jobs started */
+static int nstarting;		/* # of own jobs not yet JF_STARTED */
+static int lastpipe_rv;		/* status of the last command for JW_LASTPIPE */
+
+/* processes with a pid, hashed by it */
+#define PROC_HASHSIZE	256
+static Proc *proc_hash[PROC_HASHSIZE];
+#define proc_hashslot(pid) (&proc_hash[(unsigned int)(pid) & \
+				    (PROC_HASHSIZE - 1)])
+
+#if HAVE_VFORK
+/* errno of a failed execve(2) in a vfork(2)ed child, shared with it */
+static volatile int vfork_errno;
+#endif
 
 #ifndef CHILD_MAX
 #define CHILD_MAX	25
@@ -127,6 +149,10 @@ static int32_t njobs;		/* # of jobs started */
 #ifndef MKSH_NOPROSPECTOFWORK
 /* held_sigchld is set if sigchld occurs before a job is completely started */
 static volatile sig_atomic_t held_sigchld;
+#if HAVE_SIGNALFD
+/* reports the blocked SIGCHLD to j_waitj(); -1 if unavailable */
+static int j_sigfd = -1;
+#endif
 #endif
 
 #ifndef MKSH_UNEMPLOYED
@@ -139,15 +165,23 @@ static int const	tt_sigs[] = { SIGTSTP, SIGTTIN, SIGTTOU };
 static void		j_set_async(Job *);
 static void		j_startjob(Job *);
 static int		j_waitj(Job *, int, const char *);
+static void		j_sigwait(void);
+static int		j_nrunning(void);
+static int		j_waitnext(int, int *, pid_t *);
 static void		j_sigchld(int);
 static void		j_print(Job *, int, struct shf *);
 static Job		*j_lookup(const char *, int *);
 static Job		*new_job(void);
 static Proc		*new_proc(void);
+static void		proc_sethashed(Proc *, pid_t);
+static Proc		*proc_lookup(pid_t);
 static void		check_job(Job *);
 static void		put_job(Job *, int);
 static void		remove_job(Job *, const char *);
 static int		kill_job(Job *, int);
+#if HAVE_VFORK
+static pid_t		vfork_exec(struct op *, sigset_t *);
+#endif
 
 static void tty_init_talking(void);
 static void tty_init_state(void);
@@ -171,6 +205,18 @@ j_init(void)
 
 	setsig(&sigtraps[SIGCHLD], j_sigchld,
 	    SS_RESTORE_ORIG|SS_FORCE|SS_SHTRAP);
+#if HAVE_SIGNALFD
+	{
+		int fd;
+
+		/* also inherited by subshells, reads their signals then */
+		if ((fd = signalfd(-1, &sm_sigchld, SFD_CLOEXEC)) >= 0) {
+			j_sigfd = savefd(fd);
+			if (j_sigfd != fd)
+				close(fd);
+		}
+	}
+#endif
 #else
 	/* Make sure SIGCHLD isn't ignored - can do odd things under SYSV */
 	setsig(&sigtraps[SIGCHLD], SIG_DFL, SS_RESTORE_ORIG|SS_FORCE);
@@ -422,7 +468,10 @@ ksh_nice(int ness)
 }
 #endif
 
-/* execute tree in child subprocess */
+/*
+ * execute tree in child subprocess; returns the exit status of a
+ * foreground job, or the pid of the worker for XPFOR
+ */
 int
 exchild(struct op *t, int flags,
     volatile int *xerrok,
@@ -445,6 +494,9 @@ exchild(struct op *t, int flags,
 		jwflags |= JW_PIPEST;
 	}
 
+	/* the child can only inherit a real stdout */
+	comsub_spill();
+
 	if (flags & XEXEC)
 		/*
 		 * Clear XFORK|XPCLOSE|XCCLOSE|XCOPROC|XPIPEO|XPIPEI|XXCOM|XBGND
@@ -457,6 +509,17 @@ exchild(struct op *t, int flags,
 	sigprocmask(SIG_BLOCK, &sm_sigchld, &omask);
 #endif
 
+	/* $JOBMAX: wait for a slot before starting another async job */
+	if (ksh_jobmax && (flags & XBGND) && !(flags & XPIPEI))
+		while (j_nrunning() >= (int)ksh_jobmax) {
+			j_sigwait();
+			if (fatal_trap)
+				runtraps(TF_FATAL);
+			if (trap_pending())
+				/* let the traps run, start the job anyway */
+				break;
+		}
+
 	p = new_proc();
 	p->next = NULL;
 	p->state = PRUNNING;
@@ -483,6 +546,9 @@ exchild(struct op *t, int flags,
 		 */
 		j->flags = (flags & XXCOM) ? JF_XXCOM :
 		    ((flags & XBGND) ? 0 : (JF_FG|JF_USETTYMODE));
+		/* waited for by the loop, even if it is not waiting yet */
+		if (flags & XPFOR)
+			j->flags |= JF_PFOR | JF_WAITING;
 		timerclear(&j->usrtime);
 		timerclear(&j->systime);
 		j->state = PRUNNING;
@@ -491,15 +557,50 @@ exchild(struct op *t, int flags,
 		j->age = ++njobs;
 		j->proc_list = p;
 		j->coproc_id = 0;
+		++nstarting;
 		last_job = j;
 		last_proc = p;
 		put_job(j, PJ_PAST_STOPPED);
 	}
+	p->job = j;
 
-	vistree(p->command, sizeof(p->command), t);
+	/*
+	 * The command text is only shown for jobs which may still be
+	 * around when jobs, fg, etc. run; foreground jobs are waited
+	 * for right away, unless job control can stop them.
+	 */
+	if ((flags & XBGND)
+#ifndef MKSH_UNEMPLOYED
+	    || Flag(FMONITOR)
+#endif
+	    )
+		vistree(p->command, sizeof(p->command), t);
+	else
+		p->command[0] = '\0';
 
-	/* create child process */
+	/* create child process, not inheriting pending print output */
+	bout_flush();
 	forksleep = 1;
+#if HAVE_VFORK
+	/*
+	 * external command with redirections already done: unless the
+	 * child needs more set up than restoring signals, don't copy
+	 * the whole shell just to exec(2) it
+	 */
+	cldpid = -1;
+	if (t->type == TEXEC && !(flags & (XBGND | XPIPEI | XPIPEO |
+	    XCOPROC | XXCOM | XPCLOSE | XCCLOSE))
+#ifndef MKSH_UNEMPLOYED
+	    && !Flag(FMONITOR)
+#endif
+	    )
+#ifndef MKSH_NOPROSPECTOFWORK
+		cldpid = vfork_exec(t, &omask);
+#else
+		cldpid = vfork_exec(t, NULL);
+#endif
+	if (cldpid < 0)
+#endif
 	while ((cldpid = fork()) < 0 && errno == EAGAIN && forksleep < 32) {
 		if (intrsig)
 			/* allow user to ^C out... */
@@ -518,7 +619,7 @@ exchild(struct op *t, int flags,
 #endif
 		errorf("can't fork - try again");
 	}
-	p->pid = cldpid ? cldpid : (procpid = getpid());
+	proc_sethashed(p, cldpid ? cldpid : (procpid = getpid()));
 
 #ifndef MKSH_UNEMPLOYED
 	/* job control set up */
@@ -590,6 +691,7 @@ exchild(struct op *t, int flags,
 		sigprocmask(SIG_SETMASK, &omask, NULL);
 #endif
 		nzombie = 0;
+		nstarting = 0;
 #ifndef MKSH_UNEMPLOYED
 		ttypgrp_ok = false;
 		Flag(FMONITOR) = 0;
@@ -621,7 +723,9 @@ exchild(struct op *t, int flags,
 			/* j using co-process input */
 			coproc.job = (void *)j;
 		}
-		if (flags & XBGND) {
+		if (flags & XPFOR)
+			rv = (int)j->last_proc->pid;
+		else if (flags & XBGND) {
 			j_set_async(j);
 			if (Flag(FTALKING)) {
 				shf_fprintf(shl_out, "[%d]", j->job);
@@ -642,6 +746,61 @@ exchild(struct op *t, int flags,
 	return (rv);
 }
 
+#if HAVE_VFORK
+/*
+ * Run the TEXEC node t in a vfork(2)ed child, which only sets up the
+ * signals like restoresigs() would, applies the signal mask *cmaskp
+ * (or the current one) and execs; the fd setup was done by execute()
+ * already. Returns the pid of the child, or -1 if the caller has to
+ * fork(2) after all: vfork failed, or the execve(2) did, for example
+ * with ENOEXEC for a script, whose child then has already been reaped.
+ */
+static pid_t
+vfork_exec(struct op *t, sigset_t *cmaskp)
+{
+	union mksh_ccphack cargs;
+	struct sigaction sa;
+	sigset_t fullmask, smask;
+	char **envp;
+	Trap *p;
+	pid_t cldpid;
+	int i;
+
+	envp = makenv();
+	cargs.ro = t->args;
+	memset(&sa, 0, sizeof(sa));
+	(void)sigemptyset(&sa.sa_mask);
+	/* no shell signal handler must run in the child */
+	(void)sigfillset(&fullmask);
+	sigprocmask(SIG_SETMASK, &fullmask, &smask);
+	vfork_errno = 0;
+	if ((cldpid = vfork()) == 0) {
+		/* child: shares our memory, so only look, don't touch */
+		for (i = 1, p = &sigtraps[1]; i < NSIG; ++i, ++p) {
+			if (p->flags & TF_EXEC_IGN)
+				sa.sa_handler = SIG_IGN;
+			else if ((p->flags & TF_EXEC_DFL) ||
+			    ((p->flags & (TF_ORIG_IGN | TF_ORIG_DFL)) &&
+			    p->cursig != SIG_IGN && p->cursig != SIG_DFL))
+				sa.sa_handler = SIG_DFL;
+			else
+				continue;
+			sigaction(i, &sa, NULL);
+		}
+		sigprocmask(SIG_SETMASK, cmaskp ? cmaskp : &smask, NULL);
+		execve(t->str, cargs.rw, envp);
+		vfork_errno = errno;
+		_exit(127);
+	}
+	sigprocmask(SIG_SETMASK, &smask, NULL);
+	if (cldpid > 0 && vfork_errno) {
+		waitpid(cldpid, NULL, 0);
+		cldpid = -1;
+	}
+	return (cldpid);
+}
+#endif
+
 /* start the last job: only used for $(command) jobs */
 void
 startlast(void)
@@ -718,7 +877,9 @@ waitfor(const char *cp, int *sigp)
 		 */
 		for (j = job_list; j; j = j->next)
 			/* AT&T ksh will wait for stopped jobs - we don't */
-			if (j->ppid == procpid && j->state == PRUNNING)
+			if (j->ppid == procpid && j->state == PRUNNING &&
+			    /* the rest of a lastpipe pipeline */
+			    !(j->flags & JF_FG))
 				break;
 		if (!j) {
 #ifndef MKSH_NOPROSPECTOFWORK
@@ -758,6 +919,209 @@ waitfor(const char *cp, int *sigp)
 	return (rv);
 }
 
+/*
+ * wait (built-in) -n: wait for the next of the asynchronous jobs
+ * given by wp (all if wp is NULL) to finish, unless one of them has
+ * already finished without being waited for. Returns its status and
+ * stores the pid of its last process in *pidp, or -1 if there is no
+ * such job or the wait was interrupted (then *sigp is set).
+ */
+int
+waitnext(const char **wp, int *sigp, pid_t *pidp)
+{
+	int rv, ecode, sel = 0;
+	Job *j, *jl;
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigset_t omask;
+
+	sigprocmask(SIG_BLOCK, &sm_sigchld, &omask);
+#endif
+
+	*sigp = 0;
+	if (wp != NULL) {
+		sel = JF_WAITSEL;
+		for (; *wp; ++wp)
+			if ((j = j_lookup(*wp, &ecode)))
+				j->flags |= JF_WAITSEL;
+			else if (ecode != JL_NOSUCH) {
+				for (jl = job_list; jl != NULL; jl = jl->next)
+					jl->flags &= ~JF_WAITSEL;
+#ifndef MKSH_NOPROSPECTOFWORK
+				sigprocmask(SIG_SETMASK, &omask, NULL);
+#endif
+				bi_errorf("%s: %s", *wp, lookup_msgs[ecode]);
+				return (-1);
+			}
+	}
+
+	rv = j_waitnext(sel, sigp, pidp);
+
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+#endif
+	return (rv);
+}
+
+/*
+ * Wait for one of the jobs flagged sel, or of all background jobs
+ * except parallel for workers if sel is 0, to finish; see waitnext().
+ *
+ * If jobs are compiled in then this routine expects sigchld to be blocked.
+ */
+static int
+j_waitnext(int sel, int *sigp, pid_t *pidp)
+{
+	int rv;
+	Job *j, *jl;
+	bool any;
+
+	while (/* CONSTCOND */ 1) {
+		any = false;
+		for (j = job_list; j != NULL; j = j->next) {
+			if (j->ppid != procpid || !(j->flags & JF_STARTED) ||
+			    (j->flags & (JF_FG|JF_XXCOM)) ||
+			    !(sel ? (j->flags & sel) : !(j->flags & JF_PFOR)))
+				continue;
+			if (j->state == PEXITED || j->state == PSIGNALLED)
+				break;
+			if (j->state == PRUNNING) {
+				/* keep check_job() from removing it */
+				if (!(j->flags & JF_WAITING))
+					j->flags |= JF_WAITING | JF_WAITNEXT;
+				any = true;
+			}
+		}
+		if (j != NULL || !any)
+			break;
+		j_sigwait();
+		if (fatal_trap)
+			runtraps(TF_FATAL);
+		if ((rv = trap_pending())) {
+			*sigp = 128 + rv;
+			break;
+		}
+	}
+
+	/* jobs which finished meanwhile stay for the next wait */
+	for (jl = job_list; jl != NULL; jl = jl->next) {
+		if (jl->flags & JF_WAITNEXT)
+			jl->flags &= ~JF_WAITING;
+		jl->flags &= ~(JF_WAITNEXT | JF_WAITSEL);
+	}
+
+	rv = -1;
+	if (j != NULL && !*sigp) {
+		rv = j->status;
+		*pidp = j->last_proc->pid;
+		remove_job(j, "waitnext");
+	}
+	return (rv);
+}
+
+/*
+ * Wait for the next parallel for worker to finish, like waitnext().
+ */
+int
+pfor_wait(pid_t *pidp, int *sigp)
+{
+	int rv;
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigset_t omask;
+
+	sigprocmask(SIG_BLOCK, &sm_sigchld, &omask);
+#endif
+
+	*sigp = 0;
+	rv = j_waitnext(JF_PFOR, sigp, pidp);
+
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+#endif
+	return (rv);
+}
+
+/*
+ * The parallel for loop was left early: forget its finished workers,
+ * the others become ordinary background jobs.
+ */
+void
+pfor_release(void)
+{
+	Job *j, *jnext;
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigset_t omask;
+
+	sigprocmask(SIG_BLOCK, &sm_sigchld, &omask);
+#endif
+
+	for (j = job_list; j != NULL; j = jnext) {
+		jnext = j->next;
+		if (j->ppid != procpid || !(j->flags & JF_PFOR))
+			continue;
+		if (j->state == PEXITED || j->state == PSIGNALLED)
+			remove_job(j, "pfor");
+		else
+			j->flags &= ~(JF_PFOR | JF_WAITING);
+	}
+
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+#endif
+}
+
+/*
+ * lastpipe: all but the last command of the pipeline are running,
+ * the shell itself is about to run the last one. Returns the age
+ * of the job for lastpipe_wait(); the job may be gone by then, if
+ * the last command waited for it explicitly.
+ */
+int
+lastpipe_start(void)
+{
+	Job *j = last_job;
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigset_t omask;
+
+	sigprocmask(SIG_BLOCK, &sm_sigchld, &omask);
+#endif
+
+	/* so the commands of the last one are reaped meanwhile */
+	j_startjob(j);
+
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+#endif
+	return (j->age);
+}
+
+/*
+ * lastpipe: wait for the rest of the pipeline, whose last command
+ * exited with rv in the shell, and return the status of the pipeline
+ */
+int
+lastpipe_wait(int age, int rv)
+{
+	Job *j;
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigset_t omask;
+
+	sigprocmask(SIG_BLOCK, &sm_sigchld, &omask);
+#endif
+
+	for (j = job_list; j != NULL; j = j->next)
+		if (j->age == age && j->ppid == procpid)
+			break;
+	if (j != NULL) {
+		lastpipe_rv = rv;
+		rv = j_waitj(j, JW_PIPEST | JW_LASTPIPE, "jw:lastpipe");
+	}
+
+#ifndef MKSH_NOPROSPECTOFWORK
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+#endif
+	return (rv);
+}
+
 /* kill (built-in) a job */
 int
 j_kill(const char *cp, int sig)
@@ -1086,6 +1450,8 @@ j_startjob(Job *j)
 {
 	Proc	*p;
 
+	if (!(j->flags & JF_STARTED) && j->ppid == procpid)
+		--nstarting;
 	j->flags |= JF_STARTED;
 	for (p = j->proc_list; p->next; p = p->next)
 		;
@@ -1112,9 +1478,6 @@ j_waitj(Job *j,
     const char *where)
 {
 	int rv;
-#ifdef MKSH_NO_SIGSUSPEND
-	sigset_t omask;
-#endif
 
 	/*
 	 * No auto-notify on the job we are waiting on.
@@ -1130,18 +1493,7 @@ j_waitj(Job *j,
 
 	while (j->state == PRUNNING ||
 	    ((flags & JW_STOPPEDWAIT) && j->state == PSTOPPED)) {
-#ifndef MKSH_NOPROSPECTOFWORK
-#ifdef MKSH_NO_SIGSUSPEND
-		sigprocmask(SIG_SETMASK, &sm_default, &omask);
-		pause();
-		/* note that handlers may run here so they need to know */
-		sigprocmask(SIG_SETMASK, &omask, NULL);
-#else
-		sigsuspend(&sm_default);
-#endif
-#else
-		j_sigchld(SIGCHLD);
-#endif
+		j_sigwait();
 		if (fatal_trap) {
 			int oldf = j->flags & (JF_WAITING|JF_W_ASYNCNOTIFY);
 			j->flags &= ~(JF_WAITING|JF_W_ASYNCNOTIFY);
@@ -1236,7 +1588,7 @@ j_waitj(Job *j,
 
 	j_usrtime = j->usrtime;
 	j_systime = j->systime;
-	rv = j->status;
+	rv = (flags & JW_LASTPIPE) ? lastpipe_rv : j->status;
 
 	if ((flags & JW_PIPEST) && (j->proc_list != NULL)) {
 		uint32_t num = 0;
@@ -1248,7 +1600,7 @@ j_waitj(Job *j,
 		vp->flag = DEFINED | ISSET | INTEGER | RDONLY | ARRAY | INT_U;
 		goto got_array;
 
-		while (p != NULL) {
+		while (p != NULL || (flags & JW_LASTPIPE)) {
 			{
 				struct tbl *vq;
 
@@ -1265,10 +1617,16 @@ j_waitj(Job *j,
 			vp->flag = DEFINED | ISSET | INTEGER | RDONLY |
 			    ARRAY | INT_U | AINDEX;
  got_array:
-			vp->val.i = proc_errorlevel(p);
+			if (p == NULL) {
+				/* the last command, see lastpipe_wait() */
+				vp->val.i = lastpipe_rv;
+				flags &= ~JW_LASTPIPE;
+			} else {
+				vp->val.i = proc_errorlevel(p);
+				p = p->next;
+			}
 			if (Flag(FPIPEFAIL) && vp->val.i)
 				rv = vp->val.i;
-			p = p->next;
 		}
 	}
 
@@ -1290,6 +1648,67 @@ j_waitj(Job *j,
 	return (rv);
 }
 
+/*
+ * Sleep until a signal has been handled, SIGCHLD in particular, which
+ * updates the job states.
+ *
+ * If jobs are compiled in then this routine expects sigchld to be blocked.
+ */
+static void
+j_sigwait(void)
+{
+#ifdef MKSH_NO_SIGSUSPEND
+	sigset_t omask;
+#endif
+
+#ifndef MKSH_NOPROSPECTOFWORK
+#if HAVE_SIGNALFD
+	if (j_sigfd >= 0) {
+		struct signalfd_siginfo ssi;
+
+		/*
+		 * SIGCHLD stays blocked and is picked up here, so
+		 * children are reaped synchronously; other signals
+		 * interrupt the read(2), as they do sigsuspend(2)
+		 */
+		if (read(j_sigfd, &ssi, sizeof(ssi)) > 0)
+			j_sigchld(SIGCHLD);
+	} else {
+#endif
+#ifdef MKSH_NO_SIGSUSPEND
+	sigprocmask(SIG_SETMASK, &sm_default, &omask);
+	pause();
+	/* note that handlers may run here so they need to know */
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+#else
+	sigsuspend(&sm_default);
+#endif
+#if HAVE_SIGNALFD
+	}
+#endif
+#else
+	j_sigchld(SIGCHLD);
+#endif
+}
+
+/*
+ * Count the running asynchronous jobs of this shell.
+ *
+ * If jobs are compiled in then this routine expects sigchld to be blocked.
+ */
+static int
+j_nrunning(void)
+{
+	Job *j;
+	int n = 0;
+
+	for (j = job_list; j != NULL; j = j->next)
+		if (j->ppid == procpid && j->state == PRUNNING &&
+		    (j->flags & JF_STARTED) && !(j->flags & (JF_FG|JF_XXCOM)))
+			++n;
+	return (n);
+}
+
 /*
  * SIGCHLD handler to reap children and update job states
  *
@@ -1319,11 +1738,10 @@ j_sigchld(int sig MKSH_A_UNUSED)
 	 * before all the processes in a pipe line are started (so the
 	 * setpgid() won't fail)
 	 */
-	for (j = job_list; j; j = j->next)
-		if (j->ppid == procpid && !(j->flags & JF_STARTED)) {
-			held_sigchld = 1;
-			goto j_sigchld_out;
-		}
+	if (nstarting) {
+		held_sigchld = 1;
+		goto j_sigchld_out;
+	}
 #endif
 
 	getrusage(RUSAGE_CHILDREN, &ru0);
@@ -1348,11 +1766,7 @@ j_sigchld(int sig MKSH_A_UNUSED)
 		getrusage(RUSAGE_CHILDREN, &ru1);
 
 		/* find job and process structures for this pid */
-		for (j = job_list; j != NULL; j = j->next)
-			for (p = j->proc_list; p != NULL; p = p->next)
-				if (p->pid == pid)
-					goto found;
- found:
+		j = (p = proc_lookup(pid)) ? p->job : NULL;
 		if (j == NULL) {
 			/* Can occur if process has kids, then execs shell
 			warningf(true, "bad process waited for (pid = %d)",
@@ -1638,9 +2052,9 @@ j_lookup(const char *cp, int *ecodep)
 	if (ksh_isdigit(*cp)) {
 		getn(cp, &job);
 		/* Look for last_proc->pid (what $! returns) first... */
-		for (j = job_list; j != NULL; j = j->next)
-			if (j->last_proc && j->last_proc->pid == job)
-				return (j);
+		for (p = *proc_hashslot(job); p != NULL; p = p->hnext)
+			if (p->pid == job && p->job->last_proc == p)
+				return (p->job);
 		/*
 		 * ...then look for process group (this is non-POSIX,
 		 * but should not break anything
@@ -1728,8 +2142,9 @@ static Proc	*free_procs;
 static Job *
 new_job(void)
 {
-	int	i;
+	int	i, n;
 	Job	*newj, *j;
+	char	*used;
 
 	if (free_jobs != NULL) {
 		newj = free_jobs;
@@ -1737,13 +2152,19 @@ new_job(void)
 	} else
 		newj = alloc(sizeof(Job), APERM);
 
-	/* brute force method */
-	for (i = 1; ; i++) {
-		for (j = job_list; j && j->job != i; j = j->next)
-			;
-		if (j == NULL)
-			break;
-	}
+	/* with n jobs, the lowest free job number is at most n + 1 */
+	n = 0;
+	for (j = job_list; j != NULL; j = j->next)
+		++n;
+	used = alloc(n + 2, ATEMP);
+	memset(used, 0, n + 2);
+	for (j = job_list; j != NULL; j = j->next)
+		/* zombies have job number -1 */
+		if (j->job > 0 && j->job <= n)
+			used[j->job] = 1;
+	for (i = 1; used[i]; i++)
+		;
+	afree(used, ATEMP);
 	newj->job = i;
 
 	return (newj);
@@ -1768,6 +2189,46 @@ new_proc(void)
 	return (p);
 }
 
+/*
+ * Set the pid of p, which has none (0) or the one it was hashed by,
+ * and (re)hash it; pid 0 just unhashes it.
+ *
+ * If jobs are compiled in then this routine expects sigchld to be blocked.
+ */
+static void
+proc_sethashed(Proc *p, pid_t pid)
+{
+	Proc **pp;
+
+	if (p->pid != 0) {
+		for (pp = proc_hashslot(p->pid); *pp != p; pp = &(*pp)->hnext)
+			;
+		*pp = p->hnext;
+	}
+	if ((p->pid = pid) != 0) {
+		pp = proc_hashslot(pid);
+		p->hnext = *pp;
+		*pp = p;
+	}
+}
+
+/*
+ * Find the process with the given pid, the newest one if there are
+ * more (e.g. from the parent shell's job list in a subshell).
+ *
+ * If jobs are compiled in then this routine expects sigchld to be blocked.
+ */
+static Proc *
+proc_lookup(pid_t pid)
+{
+	Proc *p;
+
+	for (p = *proc_hashslot(pid); p != NULL; p = p->hnext)
+		if (p->pid == pid)
+			break;
+	return (p);
+}
+
 /*
  * Take job out of job_list and put old structures into free list.
  * Keeps nzombies, last_job and async_job up to date.
@@ -1797,12 +2258,15 @@ remove_job(Job *j, const char *where)
 	for (p = j->proc_list; p != NULL; ) {
 		tmp = p;
 		p = p->next;
+		proc_sethashed(tmp, 0);
 		tmp->next = free_procs;
 		free_procs = tmp;
 	}
 
 	if ((j->flags & JF_ZOMBIE) && j->ppid == procpid)
 		--nzombie;
+	if (!(j->flags & JF_STARTED) && j->ppid == procpid)
+		--nstarting;
 	j->next = free_jobs;
 	free_jobs = j;
 
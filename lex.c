@@ -1364,9 +1364,10 @@ getsc_uu(void)
 static void
 getsc_line(Source *s)
 {
-	char *xp = Xstring(s->xs, xp), *cp;
+	char *xp = Xstring(s->xs, xp), *cp = NULL;
 	bool interactive = Flag(FTALKING) && s->type == SSTDIN;
 	bool have_tty = tobool(interactive && (s->flags & SF_TTY));
+	bool held;
 
 	/* Done here to ensure nothing odd happens when a timeout occurs */
 	XcheckN(s->xs, xp, LINE);
@@ -1377,6 +1378,9 @@ getsc_line(Source *s)
 		ksh_tmout_state = TMOUT_READING;
 		alarm(ksh_tmout);
 	}
+	if (s->type == SSTDIN)
+		/* whoever feeds us commands may wait for the output */
+		bout_flush();
 	if (interactive)
 		change_winsz();
 #ifndef MKSH_NO_CMDLINE_EDITING
@@ -1401,7 +1405,13 @@ getsc_line(Source *s)
 		else
 			s->line++;
 
-		while (/* CONSTCOND */ 1) {
+		/* script files: use the line where it was read to */
+		held = tobool(s->flags & SF_HELD);
+		s->flags &= ~SF_HELD;
+		if (s->type == SFILE && (cp = shf_getsl(s->u.shf, &xp,
+		    &s->ugbuf[0], held)) != NULL)
+			s->flags |= SF_HELD;
+		else while (/* CONSTCOND */ 1) {
 			char *p = shf_getse(xp, Xnleft(s->xs, xp), s->u.shf);
 
 			if (!p && shf_error(s->u.shf) &&
@@ -1439,12 +1449,13 @@ getsc_line(Source *s)
 		ksh_tmout_state = TMOUT_EXECUTING;
 		alarm(0);
 	}
-	cp = Xstring(s->xs, xp);
+	if (!(s->flags & SF_HELD))
+		cp = Xstring(s->xs, xp);
 	rndpush(cp);
 	s->start = s->str = cp;
-	strip_nuls(Xstring(s->xs, xp), Xlength(s->xs, xp));
+	strip_nuls(cp, xp - cp);
 	/* Note: if input is all nulls, this is not eof */
-	if (Xlength(s->xs, xp) == 0) {
+	if (xp == cp) {
 		/* EOF */
 		if (s->type == SFILE)
 			shf_fdclose(s->u.shf);
@@ -232,7 +232,7 @@ main_init(int argc, const char *argv[], Source **sp, struct block **lp)
 
 	/* define built-in commands and see if we were called as one */
 	ktinit(APERM, &builtins,
-	    /* currently up to 51 builtins: 75% of 128 = 2^7 */
+	    /* currently up to 59 builtins: 75% of 128 = 2^7 */
 	    7);
 	for (i = 0; mkshbuiltins[i].name != NULL; i++)
 		if (!strcmp(ccp, builtin(mkshbuiltins[i].name,
@@ -491,8 +491,9 @@ main_init(int argc, const char *argv[], Source **sp, struct block **lp)
 	} else if (argi < argc && !Flag(FSTDIN)) {
 		s = pushs(SFILE, ATEMP);
 		s->file = argv[argi++];
+		/* small buffer: see what happens to the file while run */
 		s->u.shf = shf_open(s->file, O_RDONLY, 0,
-		    SHF_MAPHI | SHF_CLEXEC);
+		    SHF_MAPHI | SHF_CLEXEC | SHF_NOGROW);
 		if (s->u.shf == NULL) {
 			shl_stdout_ok = false;
 			warningf(true, "%s: %s", s->file, cstrerror(errno));
@@ -675,6 +676,7 @@ main(int argc, const char *argv[])
 	if ((rv = main_init(argc, argv, &s, &l)) == 0) {
 		if (Flag(FAS_BUILTIN)) {
 			rv = shcomexec(l->argv);
+			bout_flush();
 		} else {
 			shell(s, true);
 			/* NOTREACHED */
@@ -692,7 +694,7 @@ include(const char *name, int argc, const char **argv, bool intr_ok)
 	volatile int old_argc;
 	int i;
 
-	shf = shf_open(name, O_RDONLY, 0, SHF_MAPHI | SHF_CLEXEC);
+	shf = shf_open(name, O_RDONLY, 0, SHF_MAPHI | SHF_CLEXEC | SHF_NOGROW);
 	if (shf == NULL)
 		return (-1);
 
@@ -986,11 +988,16 @@ quitenv(struct shf *shf)
 		int i;
 #endif
 
+		bout_flush();
 		if (ep->type == E_NONE) {
 			/* Main shell exiting? */
 #if HAVE_PERSISTENT_HISTORY
 			if (Flag(FTALKING))
 				hist_finish();
+#endif
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+			if (procpid == kshpid)
+				hashfile_finish();
 #endif
 			j_exit();
 			if (ep->flags & EF_FAKE_SIGDIE) {
@@ -1410,6 +1417,7 @@ ksh_dup2(int ofd, int nfd, bool errok)
 {
 	int rv;
 
+	bout_fdchange(nfd);
 	if (((rv = dup2(ofd, nfd)) < 0) && !errok && (errno != EBADF))
 		errorf("too many files open in shell");
 
@@ -1443,6 +1451,7 @@ savefd(int fd)
 void
 restfd(int fd, int ofd)
 {
+	bout_fdchange(fd);
 	if (fd == 2)
 		shf_flush(&shf_iob[/* fd */ 2]);
 	if (ofd < 0)
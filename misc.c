@@ -304,13 +304,20 @@ change_flag(enum sh_flag f, int what, bool newset)
 void
 change_xtrace(unsigned char newval, bool dosnapshot)
 {
+	int fd;
+
 	if (!dosnapshot && newval == Flag(FXTRACE))
 		return;
 
 	if (Flag(FXTRACE) == 2) {
 		shf_putc('\n', shl_xtrace);
 		Flag(FXTRACE) = 1;
-		shf_flush(shl_xtrace);
+		xtrace_line(true);
+	}
+	if (xtrace_newfd) {
+		/* $XTRACEFD was set in the line just finished */
+		xtrace_newfd = false;
+		dosnapshot = true;
 	}
 
 	if (!dosnapshot && Flag(FXTRACE) == 1)
@@ -324,12 +331,16 @@ change_xtrace(unsigned char newval, bool dosnapshot)
 	shf_flush(shl_xtrace);
 	if (shl_xtrace->fd != 2)
 		close(shl_xtrace->fd);
-	if (!newval || (shl_xtrace->fd = savefd(2)) == -1)
-		shl_xtrace->fd = 2;
+	if (!newval || (fd = savefd(ksh_xtracefd)) == -1)
+		fd = 2;
+	/* a new fd may want a different buffer size */
+	shf_reopen(fd, SHF_WR, shl_xtrace);
 
  changed_xtrace:
-	if ((Flag(FXTRACE) = newval) == 2)
+	if ((Flag(FXTRACE) = newval) == 2) {
+		xtrace_line(false);
 		shf_puts(substitute(str_val(global("PS4")), 0), shl_xtrace);
+	}
 }
 
 /*
@@ -0,0 +1,428 @@
+/*-
+ * Copyright (c) 2026
+ *	agent <agent@local>
+ *
+ * Provided that these terms and disclaimer and all copyright notices
+ * are retained or reproduced in an accompanying document, permission
+ * is granted to deal in this work without restriction, including un-
+ * limited rights to use, publicly perform, distribute, sell, modify,
+ * merge, give away, or sublicence.
+ *
+ * This work is provided "AS IS" and WITHOUT WARRANTY of any kind, to
+ * the utmost extent permitted by applicable law, neither express nor
+ * implied; without malicious intent or gross negligence. In no event
+ * may a licensor, author or contributor be held liable for indirect,
+ * direct, other damage, loss, or other issues arising in any way out
+ * of dealing in the work, even if advised of the possibility of such
+ * damage or existence of a defect, except proven that it results out
+ * of said person's immediate fault when using the work as intended.
+ *-
+ * printf(1) as builtin, on top of shf_fprintf(); like there, floating
+ * point conversions are not supported.
+ */
+
+#include "sh.h"
+
+/* returned by pf_format() */
+#define PF_ERROR	BIT(0)	/* a conversion failed, keep going */
+#define PF_STOP		BIT(1)	/* \c or bad format, stop output */
+
+static int pf_format(const char *, const char ***, struct shf *);
+static void pf_bksl(const char *, XString *, char **, int *);
+static long pf_number(const char *, bool, int *);
+static int pf_star(const char ***, int *);
+static void pf_prec(struct shf *, const char *, int, long, int, int);
+static int pf_get(void);
+static void pf_put(int);
+
+static const char *pf_ptr;
+
+int
+c_printf(const char **wp)
+{
+	const char *fmt, *vname = NULL, **owp;
+	struct shf *shf, so;
+	struct tbl *vp;
+	char *cp;
+	int optc, rv = 0, i;
+	ssize_t n;
+
+	while ((optc = ksh_getopt(wp, &builtin_opt, "v:")) != -1)
+		switch (optc) {
+		case 'v':
+			vname = builtin_opt.optarg;
+			break;
+		case '?':
+			return (1);
+		}
+	wp += builtin_opt.optind;
+	if ((fmt = *wp++) == NULL) {
+		bi_errorf("%s: %s", "usage",
+		    "printf [-v name] format [argument ...]");
+		return (1);
+	}
+	if (vname != NULL && (!*vname || *skip_varname(vname, true))) {
+		bi_errorf("%s: %s", vname, "is not an identifier");
+		return (1);
+	}
+
+	/* the format is reused as long as it consumes arguments */
+	shf_sopen(NULL, 0, SHF_WR | SHF_DYNAMIC, &so);
+	do {
+		owp = wp;
+		i = pf_format(fmt, &wp, &so);
+		if (i & PF_ERROR)
+			rv = 1;
+	} while (!(i & PF_STOP) && *wp != NULL && wp != owp);
+	n = so.wp - so.buf;
+	cp = shf_sclose(&so);
+
+	if (vname != NULL) {
+		vp = global(vname);
+		if (!setstr(vp, cp, KSH_RETURN_ERROR))
+			rv = 1;
+	} else if (n > 0) {
+		/* like print and echo, see shf.c */
+		if (shl_capture != NULL || (shf = bout_get(1)) == NULL)
+			shf = shl_stdout;
+		if (shf_write(cp, n, shf) == EOF)
+			rv = 1;
+	}
+	afree(cp, ATEMP);
+	return (rv);
+}
+
+/* output fmt once, consuming arguments from *wpp */
+static int
+pf_format(const char *fmt, const char ***wpp, struct shf *shf)
+{
+	const char *arg;
+	/* '%', five flags, '-', width, '.', precision, 'l', conversion */
+	char spec[1 + 5 + 1 + 10 + 1 + 10 + 2 + 1], *cp, *pp, *xp;
+	int c, rv = 0, width, prec;
+	bool haswidth, hasprec;
+	XString xs;
+
+	while ((c = *fmt++) != '\0') {
+		if (c == '\\') {
+			pf_ptr = fmt;
+			c = unbksl(true, pf_get, pf_put);
+			fmt = pf_ptr;
+			if (c == -1) {
+				/* unknown escape, keep the backslash */
+				shf_putc('\\', shf);
+				if (*fmt)
+					shf_putc(*fmt++, shf);
+			} else if ((unsigned int)c > 0xFF) {
+				char ts[4];
+
+				shf_write(ts, (ssize_t)utf_wctomb(ts,
+				    c - 0x100), shf);
+			} else
+				shf_putc(c, shf);
+			continue;
+		}
+		if (c != '%') {
+			shf_putc(c, shf);
+			continue;
+		}
+		if (*fmt == '%') {
+			shf_putc(*fmt++, shf);
+			continue;
+		}
+
+		/* flags, field width and precision */
+		cp = spec;
+		*cp++ = '%';
+		while ((c = *fmt) && vstrchr("-+ #0", c)) {
+			/* each flag only once */
+			if (!memchr(spec + 1, c, cp - spec - 1))
+				*cp++ = c;
+			++fmt;
+		}
+		haswidth = hasprec = false;
+		width = prec = 0;
+		if (*fmt == '*') {
+			++fmt;
+			haswidth = true;
+			width = pf_star(wpp, &rv);
+		} else if (ksh_isdigit(*fmt)) {
+			haswidth = true;
+			width = (int)pf_number(fmt, false, NULL);
+			while (ksh_isdigit(*fmt))
+				++fmt;
+		}
+		if (*fmt == '.') {
+			++fmt;
+			hasprec = true;
+			if (*fmt == '*') {
+				++fmt;
+				prec = pf_star(wpp, &rv);
+			} else {
+				prec = (int)pf_number(fmt, false, NULL);
+				while (ksh_isdigit(*fmt))
+					++fmt;
+			}
+			if (prec < 0)
+				hasprec = false;
+		}
+		if (haswidth && width < 0) {
+			if (!memchr(spec + 1, '-', cp - spec - 1))
+				*cp++ = '-';
+			width = -width;
+		}
+		/* length modifiers have no meaning here */
+		while ((c = *fmt) && vstrchr("hlLjtz", c))
+			++fmt;
+		if (haswidth)
+			cp += shf_snprintf(cp, 12, "%d", width);
+		pp = cp;
+		if (hasprec)
+			cp += shf_snprintf(cp, 13, ".%d", prec);
+		*cp = '\0';
+
+		if ((c = *fmt++) == '\0') {
+			bi_errorf("%s: %s", "missing conversion character",
+			    spec);
+			return (rv | PF_ERROR | PF_STOP);
+		}
+		arg = **wpp;
+		if (arg != NULL && c != '%')
+			++*wpp;
+		if (!vstrchr("diouxX", c) &&
+		    (xp = memchr(spec, '#', cp - spec)) != NULL) {
+			/* shf_vfprintf() quotes for %#s */
+			memmove(xp, xp + 1, cp - xp);
+			--pp;
+			--cp;
+		}
+		switch (c) {
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			if (hasprec) {
+				pf_prec(shf, spec, c, pf_number(arg,
+				    c != 'd' && c != 'i', &rv), width, prec);
+				break;
+			}
+			*cp++ = 'l';
+			*cp++ = c;
+			*cp = '\0';
+			shf_fprintf(shf, spec, pf_number(arg,
+			    c != 'd' && c != 'i', &rv));
+			break;
+		case 'c':
+			if (arg != NULL && *arg) {
+				/* one character */
+				cp = pp;
+				*cp++ = '.';
+				*cp++ = '1';
+			}
+			/* FALLTHROUGH */
+		case 's':
+			*cp++ = 's';
+			*cp = '\0';
+			shf_fprintf(shf, spec, arg ? arg : null);
+			break;
+		case 'b':
+			Xinit(xs, xp, 64, ATEMP);
+			pf_bksl(arg ? arg : null, &xs, &xp, &rv);
+			if (!haswidth && !hasprec)
+				/* may contain NULs */
+				shf_write(Xstring(xs, xp), Xlength(xs, xp),
+				    shf);
+			else {
+				Xput(xs, xp, '\0');
+				*cp++ = 's';
+				*cp = '\0';
+				shf_fprintf(shf, spec, Xstring(xs, xp));
+			}
+			Xfree(xs, xp);
+			if (rv & PF_STOP)
+				return (rv);
+			break;
+		case 'q':
+			print_value_quoted(shf, arg ? arg : null);
+			break;
+		case '%':
+			shf_putc('%', shf);
+			break;
+		case 'a':
+		case 'A':
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+			bi_errorf("%%%c: %s", c,
+			    "floating point not supported");
+			rv |= PF_ERROR;
+			break;
+		default:
+			bi_errorf("%%%c: %s", c, "invalid conversion");
+			return (rv | PF_ERROR | PF_STOP);
+		}
+	}
+	return (rv);
+}
+
+/*
+ * shf_vfprintf() pads a number to its precision like to a field width,
+ * so a number with a precision is done here, as in printf(3): zeroes
+ * after the sign or 0x up to prec digits, then spaces up to width
+ */
+static void
+pf_prec(struct shf *shf, const char *spec, int c, long num, int width,
+    int prec)
+{
+	char fmt[8], buf[32], *cp = fmt;
+	const char *dp;
+	int len;
+	bool left = false, alt = false;
+
+	/* the flags of spec but '-' and '0', no width and no precision */
+	*cp++ = '%';
+	while (*++spec && vstrchr("-+ #0", *spec))
+		if (*spec == '-')
+			left = true;
+		else if (*spec == '#') {
+			/* no 0x for zero */
+			if ((alt = (num != 0 || c == 'o')))
+				*cp++ = '#';
+		} else if (*spec != '0')
+			*cp++ = *spec;
+	*cp++ = 'l';
+	*cp++ = c;
+	*cp = '\0';
+	len = shf_snprintf(buf, sizeof(buf), fmt, num);
+
+	dp = buf;
+	if (*dp == '-' || *dp == '+' || *dp == ' ')
+		++dp;
+	else if (alt && (c == 'x' || c == 'X') && dp[0] == '0' &&
+	    (dp[1] | 0x20) == 'x')
+		dp += 2;
+	if (prec == 0 && num == 0 && !(alt && c == 'o'))
+		/* no digits at all */
+		len = dp - buf;
+	/* from here on, the number of zeroes and of spaces */
+	prec -= len - (dp - buf);
+	if (prec < 0)
+		prec = 0;
+	width -= len + prec;
+
+	while (!left && width-- > 0)
+		shf_putc(' ', shf);
+	shf_write(buf, dp - buf, shf);
+	while (prec-- > 0)
+		shf_putc('0', shf);
+	shf_write(dp, len - (dp - buf), shf);
+	while (width-- > 0)
+		shf_putc(' ', shf);
+}
+
+/* %b: expand the backslash sequences of print and echo */
+static void
+pf_bksl(const char *s, XString *xsp, char **xpp, int *rvp)
+{
+	char *xp = *xpp;
+	int c;
+
+	while ((c = *s++) != '\0') {
+		Xcheck(*xsp, xp);
+		if (c == '\\') {
+			pf_ptr = s;
+			c = unbksl(false, pf_get, pf_put);
+			s = pf_ptr;
+			if (c == -1) {
+				if (*s == 'c') {
+					/* no more output at all */
+					*rvp |= PF_STOP;
+					break;
+				}
+				Xput(*xsp, xp, '\\');
+				if (*s == '\0')
+					continue;
+				c = *s++;
+			} else if ((unsigned int)c > 0xFF) {
+				XcheckN(*xsp, xp, 4);
+				xp += utf_wctomb(xp, c - 0x100);
+				continue;
+			}
+		}
+		Xput(*xsp, xp, c);
+	}
+	*xpp = xp;
+}
+
+/*
+ * the value of a numeric argument; a leading quote gives the value
+ * of the character after it; rvp is NULL for digits in the format
+ */
+static long
+pf_number(const char *s, bool isunsigned, int *rvp)
+{
+	unsigned int wc;
+	long num;
+	char *ep;
+
+	if (s == NULL)
+		return (0);
+	if (*s == '\'' || *s == '"') {
+		if (UTFMODE && (unsigned char)s[1] >= 0x80 &&
+		    utf_mbtowc(&wc, s + 1) != (size_t)-1)
+			return ((long)wc);
+		return ((long)(unsigned char)s[1]);
+	}
+	errno = 0;
+	if (isunsigned && *s != '-')
+		num = (long)strtoul(s, &ep, 0);
+	else
+		num = strtol(s, &ep, 0);
+	if (rvp == NULL)
+		/* digits in the format, ended by the conversion */
+		return (errno || num > 2147483647L ? 0 : num);
+	if (errno == ERANGE) {
+		bi_errorf("%s: %s", s, cstrerror(errno));
+		*rvp |= PF_ERROR;
+	} else if (ep == s || *ep != '\0') {
+		bi_errorf("%s: %s", s, ep == s ? "expected numeric value" :
+		    "not completely converted");
+		*rvp |= PF_ERROR;
+	}
+	return (num);
+}
+
+/* the argument for a '*' width or precision, at most 2147483647 either way */
+static int
+pf_star(const char ***wpp, int *rvp)
+{
+	long num;
+
+	if (**wpp == NULL)
+		return (0);
+	num = pf_number(**wpp, false, rvp);
+	if (num < -2147483647L || num > 2147483647L) {
+		bi_errorf("%s: %s", **wpp, "out of range");
+		*rvp |= PF_ERROR;
+		num = 0;
+	}
+	++*wpp;
+	return ((int)num);
+}
+
+static int
+pf_get(void)
+{
+	return (*pf_ptr++);
+}
+
+static void
+pf_put(int c MKSH_A_UNUSED)
+{
+	--pf_ptr;
+}
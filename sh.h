@@ -405,6 +405,25 @@ extern int __cdecl setegid(gid_t);
 #define O_BINARY	0
 #endif
 
+#if HAVE_MMAP
+/*XXX imake style */
+#if defined(__linux)
+#define caddr_cast(x)	((void *)(x))
+#else
+#define caddr_cast(x)	((caddr_t)(x))
+#endif
+
+/* several OEs do not have these constants */
+#ifndef MAP_FAILED
+#define MAP_FAILED	caddr_cast(-1)
+#endif
+
+/* some OEs need the default mapping type specified */
+#ifndef MAP_FILE
+#define MAP_FILE	0
+#endif
+#endif
+
 #ifdef MKSH__NO_SYMLINK
 #undef S_ISLNK
 #define S_ISLNK(m)	(/* CONSTCOND */ 0)
@@ -462,6 +481,13 @@ EXTERN const char initvsn[] E_INIT("KSH_VERSION=@(#)" KSH_VERSIONNAME \
 
 EXTERN const char digits_uc[] E_INIT("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ");
 EXTERN const char digits_lc[] E_INIT("0123456789abcdefghijklmnopqrstuvwxyz");
+/* "00" to "99", for converting to decimal two digits at a time */
+EXTERN const char digits_dec2[] E_INIT(
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899");
 
 /*
  * Evil hack for const correctness due to API brokenness
@@ -746,6 +772,7 @@ EXTERN int exstat;		/* exit status */
 EXTERN int subst_exstat;	/* exit status of last $(..)/`..` */
 EXTERN struct tbl *vp_pipest;	/* global PIPESTATUS array */
 EXTERN short trap_exstat;	/* exit status before running a trap */
+EXTERN unsigned int exec_serial; /* bumped by execute(), for caches */
 EXTERN uint8_t trap_nested;	/* running nested traps */
 EXTERN uint8_t shell_flags[FNFLAGS];
 EXTERN const char *kshname;	/* $0 */
@@ -835,12 +862,15 @@ struct temp {
  */
 
 #define shl_xtrace	(&shf_iob[0])	/* for set -x */
-#define shl_stdout	(&shf_iob[1])
+/* stdout, unless captured in memory by a fork-free command substitution */
+#define shl_stdout	(shl_capture ? shl_capture : &shf_iob[1])
 #define shl_out		(&shf_iob[2])
 #ifdef DF
 #define shl_dbg		(&shf_iob[3])	/* for DF() */
 #endif
 EXTERN bool shl_stdout_ok;
+/* see comsub(): where fd 1 output goes while it is only virtual */
+EXTERN struct shf *shl_capture E_INIT(NULL);
 
 /*
  * trap handlers
@@ -903,6 +933,13 @@ enum tmout_enum {
 	TMOUT_LEAVING		/* have timed out */
 };
 EXTERN unsigned int ksh_tmout;
+
+/* $JOBMAX: limit for running asynchronous jobs, 0 if none */
+EXTERN unsigned int ksh_jobmax E_INIT(0);
+/* $XTRACEFD: where set -x output goes, see change_xtrace() */
+EXTERN int ksh_xtracefd E_INIT(2);
+/* $XTRACEFD changed while a trace line was being written */
+EXTERN bool xtrace_newfd E_INIT(false);
 EXTERN enum tmout_enum ksh_tmout_state E_INIT(TMOUT_EXECUTING);
 
 /* For "You have stopped jobs" message */
@@ -1051,7 +1088,7 @@ EXTERN mksh_ari_t x_lins E_INIT(24);	/* tty lines */
 #define SHF_CLEXEC	0x0010		/* set close on exec flag */
 #define SHF_MAPHI	0x0020		/* make fd > FDBASE (and close orig)
 					 * (shf_open() only) */
-#define SHF_DYNAMIC	0x0040		/* string: increase buffer as needed */
+#define SHF_DYNAMIC	0x0040		/* increase buffer as needed */
 #define SHF_INTERRUPT	0x0080		/* EINTR in read/write causes error */
 /* Flags used internally */
 #define SHF_STRING	0x0100		/* a string, not a file */
@@ -1061,6 +1098,7 @@ EXTERN mksh_ari_t x_lins E_INIT(24);	/* tty lines */
 #define SHF_EOF		0x1000		/* read eof (sticky) */
 #define SHF_READING	0x2000		/* currently reading: rnleft,rp valid */
 #define SHF_WRITING	0x4000		/* currently writing: wnleft,wp valid */
+#define SHF_NOGROW	0x8000		/* keep the buffer small (a tty etc.) */
 
 
 struct shf {
@@ -1157,6 +1195,7 @@ EXTERN struct tbl vtemp;
 #define FDELETE		BIT(10)	/* function deleted while it was executing */
 #define FKSH		BIT(11)	/* function defined with function x (vs x()) */
 #define SPEC_BI		BIT(12)	/* a POSIX special builtin */
+#define LOADED_BI	BIT(13)	/* loaded by builtin -f, writes to fd 1 */
 /*
  * Attributes that can be set by the user (used to decide if an unset
  * param should be repoted by set/typeset). Does not include ARRAY or
@@ -1281,6 +1320,8 @@ struct op {
 		short ksh_func;
 		/* TPAT: termination character */
 		char charflag;
+		/* TPFOR: keep the output of the iterations in order */
+		bool ordered;
 	} u;
 };
 
@@ -1308,6 +1349,7 @@ struct op {
 #define TTIME		20	/* time pipeline */
 #define TEXEC		21	/* fork/exec eval'd TCOM */
 #define TCOPROC		22	/* coprocess |& */
+#define TPFOR		23	/* for -P max ... (parallel for) */
 
 /*
  * prefix codes for words in command tree
@@ -1369,6 +1411,7 @@ struct ioword {
 #define XCOPROC BIT(9)		/* starting a co-process */
 #define XTIME	BIT(10)		/* timing TCOM command */
 #define XPIPEST	BIT(11)		/* want PIPESTATUS */
+#define XPFOR	BIT(12)		/* worker of a parallel for loop */
 
 /*
  * flags to control expansion of words (assumed by t->evalflags to fit
@@ -1508,7 +1551,8 @@ struct source {
 	Source *next;		/* stacked source */
 	XString	xs;		/* input buffer */
 	char	ugbuf[2];	/* buffer for ungetsc() (SREREAD) and
-				 * alias (SALIAS) */
+				 * alias (SALIAS); SFILE: byte held by
+				 * shf_getsl() */
 };
 
 /* Source.type values */
@@ -1530,6 +1574,7 @@ struct source {
 #define SF_TTY		BIT(3)	/* type == SSTDIN & it is a tty */
 #define SF_HASALIAS	BIT(4)	/* u.tblp valid (SALIAS, SEOF) */
 #define SF_MAYEXEC	BIT(5)	/* special sh -c optimisation hack */
+#define SF_HELD		BIT(6)	/* str is in u.shf, ugbuf[0] held */
 
 typedef union {
 	int i;
@@ -1648,6 +1693,7 @@ char *debunk(char *, const char *, size_t);
 void expand(const char *, XPtrV *, int);
 int glob_str(char *, XPtrV *, bool);
 char *tilde(char *);
+void comsub_spill(void);
 /* exec.c */
 int execute(struct op * volatile, volatile int, volatile int * volatile);
 int shcomexec(const char **);
@@ -1656,6 +1702,9 @@ int define(const char *, struct op *);
 const char *builtin(const char *, int (*)(const char **));
 struct tbl *findcom(const char *, int);
 void flushcom(bool);
+#if !defined(MKSH_SMALL) && HAVE_MMAP
+void hashfile_finish(void);
+#endif
 const char *search_path(const char *, const char *, int, int *);
 void pr_menu(const char * const *);
 void pr_list(char * const *);
@@ -1711,13 +1760,17 @@ int c_times(const char **);
 int timex(struct op *, int, volatile int *);
 void timex_hook(struct op *, char ** volatile *);
 int c_exec(const char **);
-/* dummy function (just need pointer value), special case in comexec() */
-#define c_builtin shcomexec
+/* mostly a special case in comexec(), only builtin -f gets here */
+int c_builtin(const char **);
 int c_test(const char **);
 #if HAVE_MKNOD
 int c_mknod(const char **);
 #endif
 int c_realpath(const char **);
+int c_basename(const char **);
+int c_dirname(const char **);
+int c_mkdir(const char **);
+bool builtin_external(int (*)(const char **), const char **);
 int c_rename(const char **);
 int c_cat(const char **);
 int c_sleep(const char **);
@@ -1772,6 +1825,11 @@ int exchild(struct op *, int, volatile int *, int);
 void startlast(void);
 int waitlast(void);
 int waitfor(const char *, int *);
+int waitnext(const char **, int *, pid_t *);
+int pfor_wait(pid_t *, int *);
+void pfor_release(void);
+int lastpipe_start(void);
+int lastpipe_wait(int, int);
 int j_kill(const char *, int);
 #ifndef MKSH_UNEMPLOYED
 int j_resume(const char *, int);
@@ -1897,6 +1955,7 @@ char *shf_sclose(struct shf *);
 int shf_flush(struct shf *);
 ssize_t shf_read(char *, ssize_t, struct shf *);
 char *shf_getse(char *, ssize_t, struct shf *);
+char *shf_getsl(struct shf *, char **, char *, bool);
 int shf_getchar(struct shf *s);
 int shf_ungetc(int, struct shf *);
 #if defined(MKSH_SMALL) && !defined(MKSH_SMALL_BUT_FAST)
@@ -1918,12 +1977,34 @@ char *shf_smprintf(const char *, ...)
     MKSH_A_FORMAT(__printf__, 1, 2);
 ssize_t shf_vfprintf(struct shf *, const char *, va_list)
     MKSH_A_FORMAT(__printf__, 2, 0);
+struct shf *bout_get(int);
+int bout_flush(void);
+void bout_trap(void);
+void bout_fdchange(int);
+void xtrace_line(bool);
 /* syn.c */
 void initkeywords(void);
 struct op *compile(Source *, bool);
 bool parse_usec(const char *, struct timeval *);
 char *yyrecursive(int);
 void yyrecursive_pop(bool);
+#ifdef MKSH_TEXT_BUILTINS
+/* textutil.c */
+#ifdef MKSH_HEAD_BUILTIN
+int c_head(const char **);
+#endif
+#ifdef MKSH_TAIL_BUILTIN
+int c_tail(const char **);
+#endif
+#ifdef MKSH_TR_BUILTIN
+int c_tr(const char **);
+#endif
+#ifdef MKSH_WC_BUILTIN
+int c_wc(const char **);
+#endif
+bool textutil_builtin(int (*)(const char **));
+bool textutil_external(int (*)(const char **), const char **);
+#endif
 /* tree.c */
 void fptreef(struct shf *, int, const char *, ...);
 char *snptreef(char *, ssize_t, const char *, ...);
@@ -1971,6 +2052,7 @@ uint32_t chvt_rndsetup(const void *, size_t) MKSH_A_PURE;
 mksh_ari_t rndget(void);
 void rndset(unsigned long);
 void rndpush(const void *);
+bool special_subshell(const char *);
 
 enum Test_op {
 	/* non-operator */
@@ -2017,6 +2099,13 @@ typedef struct test_env {
 	int (*eval)(struct test_env *, Test_op, const char *, const char *, bool);
 	void (*error)(struct test_env *, int, const char *);
 	int flags;			/* TEF_* */
+	/* results for one pathname, see test_cache() */
+	char *st_name;			/* NULL if nothing cached yet */
+	struct stat st_buf[2];		/* stat(2), lstat(2) result */
+	int st_rv[2];			/* their return value, 1 if not yet */
+	unsigned int st_serial;		/* exec_serial when cached */
+	unsigned char acc_tried;	/* access(2) modes tried */
+	unsigned char acc_ok;		/* access(2) modes granted */
 } Test_env;
 
 extern const char * const dbtest_tokens[];
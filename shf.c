@@ -31,6 +31,9 @@ __RCSID("$MirOS: src/bin/mksh/shf.c,v 1.62 2013/10/09 11:59:30 tg Exp $");
 #define EB_READSW	0x01	/* about to switch to reading */
 #define EB_GROW		0x02	/* grow buffer if necessary (STRING+DYNAMIC) */
 
+/* upper limit for growing the buffer of a file or pipe, see shf_grow */
+#define SHF_MAXBSIZE	65536
+
 /*
  * Replacement stdio routines. Stdio is too flakey on too many machines
  * to be useful when you have multiple processes using the same underlying
@@ -39,6 +42,32 @@ __RCSID("$MirOS: src/bin/mksh/shf.c,v 1.62 2013/10/09 11:59:30 tg Exp $");
 
 static int shf_fillbuf(struct shf *);
 static int shf_emptybuf(struct shf *, int);
+static void shf_grow(struct shf *);
+static char *shf_fmtdec(char *, unsigned long);
+
+/*
+ * Output of print and echo is collected in bout across invocations,
+ * for one file descriptor at a time, and only written out when the
+ * buffer fills up or bout_flush() is called: before the shell forks
+ * or execs, when file descriptors are redirected or restored, before
+ * anything else is written by the shell, before reads that may wait
+ * for someone to see this output, and on exit. This is only done for
+ * pipes, and only while SIGPIPE kills the shell: output to a file has
+ * to be there for whoever reads it next, and a write error must go to
+ * the print that caused it. Signals which would kill the shell without
+ * it noticing write out the buffer first, see bout_sig().
+ */
+#define BOUT_BSIZE	4096
+static struct shf bout;
+static int bout_fd = -1;
+static bool bout_caught;
+/* SIGPIPE looked at since the last bout_trap(), and at its default */
+static bool bout_sigchecked, bout_sigpipe;
+/* fds below FDBASE: 0 not looked at yet, 1 a pipe, -1 anything else */
+static signed char bout_fds[FDBASE];
+static void bout_sig(int);
+/* like the above, for set -o xtrace-batch, see xtrace_line() */
+static bool xtrace_held;
 
 /*
  * Open a file. First three args are for open(), last arg is flags for
@@ -55,16 +84,18 @@ shf_open(const char *name, int oflags, int mode, int sflags)
 	int fd, eno;
 
 	/* Done before open so if alloca fails, fd won't be lost. */
-	shf = alloc(sizeof(struct shf) + bsize, ATEMP);
+	shf = alloc(sizeof(struct shf), ATEMP);
 	shf->areap = ATEMP;
-	shf->buf = (unsigned char *)&shf[1];
+	/* separate, so that shf_grow can enlarge it */
+	shf->buf = alloc(bsize, ATEMP);
 	shf->bsize = bsize;
-	shf->flags = SHF_ALLOCS;
+	shf->flags = SHF_ALLOCS | SHF_ALLOCB;
 	/* Rest filled in by reopen. */
 
 	fd = open(name, oflags | O_BINARY, mode);
 	if (fd < 0) {
 		eno = errno;
+		afree(shf->buf, shf->areap);
 		afree(shf, shf->areap);
 		errno = eno;
 		return (NULL);
@@ -76,6 +107,7 @@ shf_open(const char *name, int oflags, int mode, int sflags)
 		eno = errno;
 		close(fd);
 		if (nfd < 0) {
+			afree(shf->buf, shf->areap);
 			afree(shf, shf->areap);
 			errno = eno;
 			return (NULL);
@@ -122,7 +154,11 @@ shf_open_hlp(int fd, int *sflagsp, const char *where)
 		internal_errorf("%s: %s", where, "missing read/write");
 }
 
-/* Set up the shf structure for a file descriptor. Doesn't fail. */
+/*
+ * Set up the shf structure for a file descriptor. Doesn't fail.
+ * The buffer is allocated separately, so that shf_grow() can
+ * enlarge it; SHF_DYNAMIC says the fd is a file or pipe anyway.
+ */
 struct shf *
 shf_fdopen(int fd, int sflags, struct shf *shf)
 {
@@ -131,17 +167,15 @@ shf_fdopen(int fd, int sflags, struct shf *shf)
 	    sflags & SHF_UNBUF ? (sflags & SHF_RD ? 1 : 0) : SHF_BSIZE;
 
 	shf_open_hlp(fd, &sflags, "shf_fdopen");
-	if (shf) {
-		if (bsize) {
-			shf->buf = alloc(bsize, ATEMP);
-			sflags |= SHF_ALLOCB;
-		} else
-			shf->buf = NULL;
-	} else {
-		shf = alloc(sizeof(struct shf) + bsize, ATEMP);
-		shf->buf = (unsigned char *)&shf[1];
+	if (!shf) {
+		shf = alloc(sizeof(struct shf), ATEMP);
 		sflags |= SHF_ALLOCS;
 	}
+	if (bsize) {
+		shf->buf = alloc(bsize, ATEMP);
+		sflags |= SHF_ALLOCB;
+	} else
+		shf->buf = NULL;
 	shf->areap = ATEMP;
 	shf->fd = fd;
 	shf->rp = shf->wp = shf->buf;
@@ -234,9 +268,12 @@ shf_close(struct shf *shf)
 		if (close(shf->fd) < 0)
 			ret = EOF;
 	}
-	if (shf->flags & SHF_ALLOCS)
+	if (shf->flags & SHF_ALLOCS) {
+		if ((shf->flags & (SHF_ALLOCB | SHF_STRING)) == SHF_ALLOCB)
+			/* growable buffer, see shf_fdopen */
+			afree(shf->buf, shf->areap);
 		afree(shf, shf->areap);
-	else if (shf->flags & SHF_ALLOCB)
+	} else if (shf->flags & SHF_ALLOCB)
 		afree(shf->buf, shf->areap);
 
 	return (ret);
@@ -357,6 +394,12 @@ shf_emptybuf(struct shf *shf, int flags)
 		shf->wbsize <<= 1;
 		shf->buf = nbuf;
 	} else {
+		if (shf == shl_xtrace)
+			/* being written out right now */
+			xtrace_held = false;
+		if (shf != &bout)
+			/* keep the order of everything written */
+			bout_flush();
 		if (shf->flags & SHF_WRITING) {
 			ssize_t n, ntowrite = shf->wp - shf->buf;
 			unsigned char *buf = shf->buf;
@@ -384,6 +427,10 @@ shf_emptybuf(struct shf *shf, int flags)
 				buf += n;
 				ntowrite -= n;
 			}
+			if ((flags & EB_GROW) &&
+			    shf->wp == shf->buf + shf->wbsize)
+				/* the buffer was full, try a larger one */
+				shf_grow(shf);
 			if (flags & EB_READSW) {
 				shf->wp = shf->buf;
 				shf->wnleft = 0;
@@ -422,6 +469,10 @@ shf_fillbuf(struct shf *shf)
 
 	shf->flags |= SHF_READING;
 
+	/* the last read filled the whole buffer, try a larger one */
+	if (shf->rp == shf->buf + shf->rbsize)
+		shf_grow(shf);
+
 	shf->rp = shf->buf;
 	while (/* CONSTCOND */ 1) {
 		n = blocking_read(shf->fd, (char *)shf->buf, shf->rbsize);
@@ -441,6 +492,44 @@ shf_fillbuf(struct shf *shf)
 	return (0);
 }
 
+/*
+ * Enlarge the buffer of shf, whose last read or write used all of it,
+ * up to SHF_MAXBSIZE: for regular files, pipes and sockets, fewer and
+ * larger system calls pay off once there is sustained traffic. Ttys
+ * and other devices keep the small buffer they started out with. The
+ * first call decides this by fstat(2), which also suggests the size.
+ */
+static void
+shf_grow(struct shf *shf)
+{
+	ssize_t nbsize = shf->rbsize << 1;
+	struct stat sb;
+
+	if ((shf->flags & (SHF_ALLOCB | SHF_STRING | SHF_UNBUF |
+	    SHF_NOGROW)) != SHF_ALLOCB || shf->rbsize >= SHF_MAXBSIZE)
+		return;
+	if (!(shf->flags & SHF_DYNAMIC)) {
+		if (fstat(shf->fd, &sb) < 0 || !(S_ISREG(sb.st_mode) ||
+		    S_ISFIFO(sb.st_mode) || S_ISSOCK(sb.st_mode))) {
+			shf->flags |= SHF_NOGROW;
+			return;
+		}
+		shf->flags |= SHF_DYNAMIC;
+#if HAVE_ST_BLKSIZE
+		if ((ssize_t)sb.st_blksize > nbsize)
+			nbsize = (ssize_t)sb.st_blksize;
+#endif
+	}
+	if (nbsize > SHF_MAXBSIZE)
+		nbsize = SHF_MAXBSIZE;
+	if (nbsize > shf->bsize) {
+		shf->rp = shf->wp = shf->buf = aresize(shf->buf, nbsize,
+		    shf->areap);
+		shf->bsize = nbsize;
+	}
+	shf->rbsize = shf->wbsize = nbsize;
+}
+
 /*
  * Read a buffer from shf. Returns the number of bytes read into buf, if
  * no bytes were read, returns 0 if end of file was seen, EOF if a read
@@ -520,6 +609,34 @@ shf_getse(char *buf, ssize_t bsize, struct shf *shf)
 	return (buf);
 }
 
+/*
+ * For the lexer: return the next line of shf, with the newline, in
+ * place in the buffer, and a pointer past it in *endp, if the line is
+ * complete in there; otherwise, return NULL after doing nothing, and
+ * shf_getse() must be used. The line is NUL terminated by overwriting
+ * the byte after it, which is saved in *heldp and must be put back by
+ * the next call, with held set, before anything else reads from shf.
+ */
+char *
+shf_getsl(struct shf *shf, char **endp, char *heldp, bool held)
+{
+	unsigned char *line = shf->rp, *end;
+
+	if (held)
+		*line = *heldp;
+	if (shf->rnleft == 0 ||
+	    (end = memchr(line, '\n', shf->rnleft)) == NULL ||
+	    ++end == shf->buf + shf->bsize)
+		/* also if there is no room for the NUL */
+		return (NULL);
+	shf->rnleft -= end - line;
+	shf->rp = end;
+	*heldp = *end;
+	*end = '\0';
+	*endp = (char *)end;
+	return ((char *)line);
+}
+
 /* Returns the char read. Returns EOF for error and end of file. */
 int
 shf_getchar(struct shf *shf)
@@ -593,6 +710,7 @@ shf_putchar(int c, struct shf *shf)
 			errno = shf->errnosv;
 			return (EOF);
 		}
+		bout_flush();
 		while ((n = write(shf->fd, &cc, 1)) != 1)
 			if (n < 0) {
 				if (errno == EINTR &&
@@ -698,6 +816,166 @@ shf_write(const char *buf, ssize_t nbytes, struct shf *shf)
 	return (orig_nbytes);
 }
 
+/*
+ * Return the buffer for output to fd, or NULL if output to it should
+ * not be delayed: anything but pipes. What fd is, is only looked at
+ * again after it was redirected, see bout_fdchange().
+ */
+struct shf *
+bout_get(int fd)
+{
+	struct stat sb;
+	struct sigaction sa;
+	bool isfifo;
+
+	if (xtrace_held) {
+		/* earlier trace lines come first */
+		xtrace_held = false;
+		shf_flush(shl_xtrace);
+	}
+	if (fd == bout_fd)
+		return (&bout);
+	bout_flush();
+	if (!bout_sigchecked) {
+		bout_sigpipe = sigaction(SIGPIPE, NULL, &sa) == 0 &&
+		    sa.sa_handler == SIG_DFL;
+		bout_sigchecked = true;
+	}
+	if (!bout_sigpipe)
+		return (NULL);
+	if (fd < 0 || fd >= FDBASE || !bout_fds[fd]) {
+		isfifo = fstat(fd, &sb) == 0 && S_ISFIFO(sb.st_mode);
+		if (fd >= 0 && fd < FDBASE)
+			bout_fds[fd] = isfifo ? 1 : -1;
+	} else
+		isfifo = bout_fds[fd] > 0;
+	if (!isfifo)
+		return (NULL);
+	if (!bout_caught) {
+		/* those of these which are not handled otherwise */
+		static const int sigs[] = {
+#ifdef SIGUSR1
+			SIGUSR1,
+#endif
+#ifdef SIGUSR2
+			SIGUSR2,
+#endif
+#ifdef SIGALRM
+			SIGALRM,
+#endif
+#ifdef SIGVTALRM
+			SIGVTALRM,
+#endif
+#ifdef SIGPROF
+			SIGPROF,
+#endif
+#ifdef SIGXCPU
+			SIGXCPU,
+#endif
+			0
+		};
+		const int *sp;
+
+		for (sp = sigs; *sp; ++sp)
+			if (sigaction(*sp, NULL, &sa) == 0 &&
+			    sa.sa_handler == SIG_DFL) {
+				sa.sa_handler = bout_sig;
+				sigemptyset(&sa.sa_mask);
+				sa.sa_flags = 0;
+				sigaction(*sp, &sa, NULL);
+			}
+		bout_caught = true;
+	}
+	if (bout.buf == NULL) {
+		bout.buf = alloc(BOUT_BSIZE, APERM);
+		bout.bsize = BOUT_BSIZE;
+	}
+	shf_reopen(fd, SHF_WR, &bout);
+	bout.wbsize = BOUT_BSIZE;
+	bout.areap = APERM;
+	bout_fd = fd;
+	return (&bout);
+}
+
+/* write out what print and echo, or set -x, left in the buffer */
+int
+bout_flush(void)
+{
+	int rv;
+
+	if (xtrace_held) {
+		xtrace_held = false;
+		shf_flush(shl_xtrace);
+	}
+	if (bout_fd < 0)
+		return (0);
+	bout_fd = -1;
+	rv = shf_flush(&bout);
+	bout.flags &= ~(SHF_WRITING | SHF_ERROR);
+	return (rv);
+}
+
+/* a trap is being changed: look at the signals again next time */
+void
+bout_trap(void)
+{
+	bout_flush();
+	bout_caught = false;
+	bout_sigchecked = false;
+}
+
+/* fd is about to be redirected, closed or restored */
+void
+bout_fdchange(int fd)
+{
+	/* print output must go where the fd pointed so far */
+	bout_flush();
+	if (fd >= 0 && fd < FDBASE)
+		bout_fds[fd] = 0;
+}
+
+/*
+ * Handler for signals which kill the shell by default: write out what
+ * is held, then die from the signal as if it had not been caught.
+ */
+static void
+bout_sig(int sig)
+{
+	const unsigned char *cp = bout.buf;
+	struct sigaction sa;
+	ssize_t n;
+
+	if (bout_fd >= 0)
+		while (cp < bout.wp && ((n = write(bout_fd, cp,
+		    bout.wp - cp)) > 0 || (n < 0 && errno == EINTR)))
+			if (n > 0)
+				cp += n;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_DFL;
+	sigaction(sig, &sa, NULL);
+	raise(sig);
+}
+
+/*
+ * Called by change_xtrace() before and after each trace line. Print
+ * output goes first; with set -o xtrace-batch, the finished line is
+ * then held in shl_xtrace, like print output in bout, until anything
+ * else is written, the shell forks, execs or exits, or the buffer is
+ * full. Otherwise, it is written out right away.
+ */
+void
+xtrace_line(bool done)
+{
+	if (!done) {
+		/* if so, nothing is held in shl_xtrace */
+		if (bout_fd >= 0)
+			bout_flush();
+	} else if (Flag(FXTRACEBATCH))
+		xtrace_held = true;
+	else
+		shf_flush(shl_xtrace);
+}
+
 ssize_t
 shf_fprintf(struct shf *shf, const char *fmt, ...)
 {
@@ -758,6 +1036,27 @@ shf_smprintf(const char *fmt, ...)
 #define FL_SIZET	0x400	/* 'z' seen */
 #define FM_SIZES	0x430	/* h/l/z mask */
 
+/* write num in decimal into the bytes before ep, return the start */
+static char *
+shf_fmtdec(char *ep, unsigned long num)
+{
+	unsigned int i;
+
+	while (num >= 100) {
+		i = (num % 100) << 1;
+		num /= 100;
+		*--ep = digits_dec2[i + 1];
+		*--ep = digits_dec2[i];
+	}
+	if (num >= 10) {
+		i = num << 1;
+		*--ep = digits_dec2[i + 1];
+		*--ep = digits_dec2[i];
+	} else
+		*--ep = num + '0';
+	return (ep);
+}
+
 ssize_t
 shf_vfprintf(struct shf *shf, const char *fmt, va_list args)
 {
@@ -783,10 +1082,95 @@ shf_vfprintf(struct shf *shf, const char *fmt, va_list args)
 
 	while ((c = *fmt++)) {
 		if (c != '%') {
-			shf_putc(c, shf);
+			/* copy runs of literal text in one go */
+			s = fmt - 1;
+			while (*fmt && *fmt != '%')
+				++fmt;
+			if ((len = fmt - s) == 1)
+				shf_putc(c, shf);
+			else
+				shf_write(s, len, shf);
+			nwritten += len;
+			continue;
+		}
+
+		/*
+		 * Most conversions used have no flags, field width and
+		 * precision: the tree printer, xtrace and error messages
+		 * get those handled here, without the general machinery.
+		 */
+		flags = 0;
+		cp = (char *)fmt;
+		if (*cp == 'l') {
+			flags = FL_LONG;
+			++cp;
+		} else if (*cp == 'z') {
+			flags = FL_SIZET;
+			++cp;
+		}
+		switch (*cp) {
+		case 's':
+			if (flags)
+				break;
+			fmt = cp + 1;
+			if ((s = VA(const char *)) == NULL)
+				s = "(null)";
+			for (len = 0; s[len]; ++len)
+				if ((unsigned char)s[len] >= 0x80 && UTFMODE)
+					break;
+			if (s[len]) {
+				/* count display columns, like below */
+				len += strlen(s + len);
+				nwritten += utf_mbswidth(s);
+			} else
+				nwritten += len;
+			shf_write(s, len, shf);
+			continue;
+		case 'c':
+			if (flags)
+				break;
+			fmt = cp + 1;
+			shf_putc((char)VA(int), shf);
 			nwritten++;
 			continue;
+		case '%':
+			if (flags)
+				break;
+			fmt = cp + 1;
+			shf_putc('%', shf);
+			nwritten++;
+			continue;
+		case 'd':
+		case 'u':
+			c = *cp;
+			fmt = cp + 1;
+			if (c == 'd') {
+				if (flags & FL_SIZET)
+					lnum = (long)VA(ssize_t);
+				else if (flags & FL_LONG)
+					lnum = VA(long);
+				else
+					lnum = (long)VA(int);
+				if ((tmp = (0 > (long)lnum)))
+					lnum = -(long)lnum;
+			} else {
+				if (flags & FL_SIZET)
+					lnum = VA(size_t);
+				else if (flags & FL_LONG)
+					lnum = VA(unsigned long);
+				else
+					lnum = (unsigned long)VA(unsigned int);
+				tmp = 0;
+			}
+			cp = shf_fmtdec(numbuf + sizeof(numbuf), lnum);
+			if (tmp)
+				*--cp = '-';
+			len = numbuf + sizeof(numbuf) - cp;
+			shf_write(cp, len, shf);
+			nwritten += len;
+			continue;
 		}
+
 		/*
 		 * This will accept flags/fields in any order - not just
 		 * the order specified in printf(3), but this is the way
@@ -931,10 +1315,7 @@ shf_vfprintf(struct shf *shf, const char *fmt, va_list args)
 					tmp = 0;
 				/* FALLTHROUGH */
 			case 'u':
-				do {
-					*--cp = lnum % 10 + '0';
-					lnum /= 10;
-				} while (lnum);
+				cp = shf_fmtdec(cp, lnum);
 
 				if (c != 'u') {
 					if (tmp)
@@ -957,6 +1338,10 @@ shf_vfprintf(struct shf *shf, const char *fmt, va_list args)
 				break;
 
 			case 'x': {
+				/*
+				 * no digits_dec2[] like table here: there
+				 * is no division to save, only shifts
+				 */
 				const char *digits = (flags & FL_UPPER) ?
 				    digits_uc : digits_lc;
 				do {
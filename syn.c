@@ -53,6 +53,7 @@ static struct op *caselist(void);
 static struct op *casepart(int);
 static struct op *function_body(char *, bool);
 static char **wordlist(void);
+static void pforopts(struct op *);
 static struct op *block(int, struct op *, struct op *);
 static struct op *newtp(int);
 static void syntaxerr(const char *) MKSH_A_NORETURN;
@@ -254,6 +255,9 @@ static const char setA_cmd1[] = {
 static const char setA_cmd2[] = {
 	CHAR, '-', CHAR, '-', EOS
 };
+static const char pfor_max0[] = {
+	CHAR, '0', EOS
+};
 
 static struct op *
 get_command(int cf)
@@ -422,6 +426,9 @@ get_command(int cf)
 	case SELECT:
 		t = newtp((c == FOR) ? TFOR : TSELECT);
 		musthave(LWORD, ARRAYVAR);
+		if (c == FOR && yylval.cp[0] == CHAR && yylval.cp[1] == '-')
+			/* for -P max [-o] [-s name] name ... */
+			pforopts(t);
 		if (!is_wdvarname(yylval.cp, true))
 			yyerror("%s: %s\n", c == FOR ? "for" : Tselect,
 			    "bad identifier");
@@ -513,6 +520,60 @@ get_command(int cf)
 	return (t);
 }
 
+/*
+ * Parse the options of a parallel for loop into t, which becomes
+ * a TPFOR; leaves the identifier in yylval. The options are single
+ * words, so they cannot be mistaken for the identifier.
+ */
+static void
+pforopts(struct op *t)
+{
+	const char *cp;
+	char *arg, *max = NULL, *sname = NULL;
+	int c;
+
+	t->type = TPFOR;
+	do {
+		/* like getopt(3): -oPmax and -o -P max are the same */
+		cp = yylval.cp + 2;
+		do {
+			if (*cp != CHAR)
+				yyerror("%s: %s\n", "for", "bad option");
+			c = cp[1];
+			cp += 2;
+			switch (c) {
+			case 'o':
+				t->u.ordered = true;
+				continue;
+			case 'P':
+			case 's':
+				if (*cp == EOS) {
+					musthave(LWORD, 0);
+					arg = yylval.cp;
+				} else
+					arg = wdcopy(cp, ATEMP);
+				cp = null;
+				break;
+			default:
+				yyerror("%s: %s\n", "for", "bad option");
+			}
+			if (c == 'P')
+				max = arg;
+			else if (!is_wdvarname(arg, false))
+				yyerror("%s: %s\n", "for -s", "bad identifier");
+			else
+				sname = arg;
+		} while (*cp != EOS);
+		musthave(LWORD, ARRAYVAR);
+	} while (yylval.cp[0] == CHAR && yylval.cp[1] == '-');
+
+	/* args[0] is the maximum, args[1] the status array, if any */
+	t->args = alloc2(3, sizeof(char *), ATEMP);
+	t->args[0] = max ? max : wdcopy(pfor_max0, ATEMP);
+	t->args[1] = sname;
+	t->args[2] = NULL;
+}
+
 static struct op *
 dogroup(void)
 {
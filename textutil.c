@@ -0,0 +1,799 @@
+/*-
+ * Copyright (c) 2026
+ *	agent <agent@local>
+ *
+ * Provided that these terms and disclaimer and all copyright notices
+ * are retained or reproduced in an accompanying document, permission
+ * is granted to deal in this work without restriction, including un-
+ * limited rights to use, publicly perform, distribute, sell, modify,
+ * merge, give away, or sublicence.
+ *
+ * This work is provided "AS IS" and WITHOUT WARRANTY of any kind, to
+ * the utmost extent permitted by applicable law, neither express nor
+ * implied; without malicious intent or gross negligence. In no event
+ * may a licensor, author or contributor be held liable for indirect,
+ * direct, other damage, loss, or other issues arising in any way out
+ * of dealing in the work, even if advised of the possibility of such
+ * damage or existence of a defect, except proven that it results out
+ * of said person's immediate fault when using the work as intended.
+ *-
+ * head(1), tail(1), tr(1) and wc(1) as builtins, for the common cases
+ * only; comexec() runs the external utility for anything else, using
+ * textutil_external() to find out.
+ */
+
+#include "sh.h"
+
+/* size of the read buffer */
+#define TU_BUFSIZ	65536
+
+/* which utility */
+#define TU_HEAD		1
+#define TU_TAIL		2
+#define TU_TR		3
+#define TU_WC		4
+
+/* struct tu.flags */
+#define TU_BYTES	BIT(0)	/* head, tail: count bytes (-c) */
+#define TU_PLUS		BIT(1)	/* tail: count from the start (+N) */
+#define TU_DELETE	BIT(2)	/* tr: -d */
+#define TU_LINES	BIT(3)	/* wc: -l; these four in output order */
+#define TU_WORDS	BIT(4)	/* wc: -w */
+#define TU_CHARS	BIT(5)	/* wc: -m */
+#define TU_OCTETS	BIT(6)	/* wc: -c */
+
+/* tr character classes, numbered in the order of tr_classes[] */
+#define TR_ALNUM	0
+#define TR_ALPHA	1
+#define TR_BLANK	2
+#define TR_CNTRL	3
+#define TR_DIGIT	4
+#define TR_GRAPH	5
+#define TR_LOWER	6
+#define TR_PRINT	7
+#define TR_PUNCT	8
+#define TR_SPACE	9
+#define TR_UPPER	10
+#define TR_XDIGIT	11
+
+/* maximum length of an expanded tr set */
+#define TR_SETMAX	1024
+
+struct tu {
+	const char **wp;		/* file operands */
+	char *buf;			/* TU_BUFSIZ bytes */
+	size_t num;			/* head, tail: count */
+	unsigned long cnt[4];		/* wc: counts of the current file */
+	unsigned long tot[4];		/* wc: totals */
+	int which;			/* TU_HEAD etc. */
+	int flags;			/* see above */
+	unsigned char map[256];		/* tr: translation table */
+	bool del[256];			/* tr: characters to delete */
+};
+
+static int tu_which(int (*)(const char **));
+static bool tu_parse(int, const char **, struct tu *, bool);
+static bool tu_count(const char *, struct tu *);
+static bool tr_sets(struct tu *, bool);
+static bool tr_expand(const char *, unsigned char *, size_t *, bool);
+static int tr_char(const char **);
+static bool tr_class(int, int);
+static int tu_main(int, const char **);
+static ssize_t tu_read(int, char *, size_t, const char *);
+static bool tu_write(const char *, size_t);
+static int tu_copy(int, const char *, struct tu *);
+static int tu_head(int, const char *, struct tu *);
+static int tu_tail(int, const char *, struct tu *);
+static int tail_plus(int, const char *, struct tu *);
+static off_t tail_back(int, const char *, struct tu *, off_t, off_t);
+static int tail_buffered(int, const char *, struct tu *);
+static size_t tail_start(const char *, size_t, struct tu *);
+static int tu_tr(int, const char *, struct tu *);
+static int tu_wc(int, const char *, struct tu *);
+static void wc_show(unsigned long *, int, const char *);
+
+static const char tr_classes[] = "alnum\0alpha\0blank\0cntrl\0"
+    "digit\0graph\0lower\0print\0punct\0space\0upper\0xdigit\0";
+
+#ifdef MKSH_HEAD_BUILTIN
+int
+c_head(const char **wp)
+{
+	return (tu_main(TU_HEAD, wp));
+}
+#endif
+
+#ifdef MKSH_TAIL_BUILTIN
+int
+c_tail(const char **wp)
+{
+	return (tu_main(TU_TAIL, wp));
+}
+#endif
+
+#ifdef MKSH_TR_BUILTIN
+int
+c_tr(const char **wp)
+{
+	return (tu_main(TU_TR, wp));
+}
+#endif
+
+#ifdef MKSH_WC_BUILTIN
+int
+c_wc(const char **wp)
+{
+	return (tu_main(TU_WC, wp));
+}
+#endif
+
+/* is f one of the builtins in this file? */
+bool
+textutil_builtin(int (*f)(const char **))
+{
+	return (tu_which(f) != 0);
+}
+
+/*
+ * true if the builtin f cannot handle the arguments ap (options, tr
+ * sets, etc.) so that the external utility must be run instead
+ */
+bool
+textutil_external(int (*f)(const char **), const char **ap)
+{
+	struct tu tu;
+	int which;
+
+	return ((which = tu_which(f)) != 0 &&
+	    !tu_parse(which, ap, &tu, false));
+}
+
+static int
+tu_which(int (*f)(const char **))
+{
+#ifdef MKSH_HEAD_BUILTIN
+	if (f == c_head)
+		return (TU_HEAD);
+#endif
+#ifdef MKSH_TAIL_BUILTIN
+	if (f == c_tail)
+		return (TU_TAIL);
+#endif
+#ifdef MKSH_TR_BUILTIN
+	if (f == c_tr)
+		return (TU_TR);
+#endif
+#ifdef MKSH_WC_BUILTIN
+	if (f == c_wc)
+		return (TU_WC);
+#endif
+	return (0);
+}
+
+/* parse the arguments into *tu; complain only if report is set */
+static bool
+tu_parse(int which, const char **wp, struct tu *tu, bool report)
+{
+	Getopt go;
+	int optc;
+
+	tu->which = which;
+	tu->flags = 0;
+	tu->num = 10;
+	memset(tu->tot, 0, sizeof(tu->tot));
+	ksh_getopt_reset(&go, 0);
+	while ((optc = ksh_getopt(wp, &go, which == TU_TR ? ":d" :
+	    which == TU_WC ? ":clmw" : ":c:n:")) != -1)
+		switch (optc) {
+		case 'c':
+			if (which == TU_WC) {
+				tu->flags |= TU_OCTETS;
+				break;
+			}
+			/* FALLTHROUGH */
+		case 'n':
+			if (optc == 'c')
+				tu->flags |= TU_BYTES;
+			else
+				tu->flags &= ~TU_BYTES;
+			if (!tu_count(go.optarg, tu)) {
+				if (report)
+					bi_errorf("%s: %s", go.optarg,
+					    "bad count");
+				return (false);
+			}
+			break;
+		case 'd':
+			tu->flags |= TU_DELETE;
+			break;
+		case 'l':
+			tu->flags |= TU_LINES;
+			break;
+		case 'm':
+			tu->flags |= TU_CHARS;
+			break;
+		case 'w':
+			tu->flags |= TU_WORDS;
+			break;
+		case ':':
+			if (report)
+				bi_errorf("-%s: %s", go.optarg,
+				    "requires an argument");
+			return (false);
+		default:
+			if (report)
+				bi_errorf("-%s: %s", go.optarg,
+				    "unknown option");
+			return (false);
+		}
+	tu->wp = wp + go.optind;
+	if (which == TU_WC && !(tu->flags &
+	    (TU_LINES | TU_WORDS | TU_CHARS | TU_OCTETS)))
+		tu->flags |= TU_LINES | TU_WORDS | TU_OCTETS;
+	return (which == TU_TR ? tr_sets(tu, report) : true);
+}
+
+/* head, tail: a line or byte count, for tail with an optional plus */
+static bool
+tu_count(const char *s, struct tu *tu)
+{
+	size_t n = 0;
+
+	tu->flags &= ~TU_PLUS;
+	if (tu->which == TU_TAIL && *s == '+') {
+		tu->flags |= TU_PLUS;
+		++s;
+	}
+	if (!ksh_isdigit(*s))
+		return (false);
+	while (ksh_isdigit(*s)) {
+		/* also keeps it in range of off_t */
+		if (n > (SIZE_MAX / 2 - 9) / 10)
+			return (false);
+		n = n * 10 + (*s++ - '0');
+	}
+	tu->num = n;
+	return (*s == '\0');
+}
+
+/* tr: build the translation or deletion table from the operands */
+static bool
+tr_sets(struct tu *tu, bool report)
+{
+	unsigned char s1[TR_SETMAX], s2[TR_SETMAX];
+	size_t n1, n2, i;
+	const char **wp = tu->wp;
+
+	if (wp[0] == NULL || ((tu->flags & TU_DELETE) ? wp[1] != NULL :
+	    (wp[1] == NULL || wp[2] != NULL))) {
+		if (report)
+			bi_errorf("%s: %s", "usage",
+			    "tr [-d] string1 [string2]");
+		return (false);
+	}
+	for (i = 0; i < 256; ++i) {
+		tu->map[i] = i;
+		tu->del[i] = false;
+	}
+	if (!tr_expand(wp[0], s1, &n1, false)) {
+		i = 0;
+		goto bad;
+	}
+	if (tu->flags & TU_DELETE) {
+		for (i = 0; i < n1; ++i)
+			tu->del[s1[i]] = true;
+		return (true);
+	}
+	/* string2 is padded with its last character */
+	if (!tr_expand(wp[1], s2, &n2, true) || (n2 == 0 && n1 != 0)) {
+		i = 1;
+		goto bad;
+	}
+	for (i = 0; i < n1; ++i)
+		tu->map[s1[i]] = s2[i < n2 ? i : n2 - 1];
+	return (true);
+
+ bad:
+	if (report)
+		bi_errorf("%s: %s", wp[i], "unsupported string");
+	return (false);
+}
+
+/* tr: expand ranges, escapes and character classes in s */
+static bool
+tr_expand(const char *s, unsigned char *dst, size_t *np, bool second)
+{
+	const char *cp;
+	size_t n = 0, i;
+	int c, last, k;
+
+	while (*s) {
+		if (s[0] == '[' && s[1] == ':') {
+			if ((cp = cstrstr(s + 2, ":]")) == NULL)
+				goto literal;
+			i = cp - (s + 2);
+			for (k = 0, cp = tr_classes; *cp; ++k, cp += strlen(cp) + 1)
+				if (!strncmp(s + 2, cp, i) && cp[i] == '\0')
+					break;
+			/* only case conversion makes sense in string2 */
+			if (!*cp || (second && k != TR_LOWER && k != TR_UPPER))
+				return (false);
+			s += i + 4;
+			for (c = 0; c < 128; ++c)
+				if (tr_class(k, c)) {
+					if (n == TR_SETMAX)
+						return (false);
+					dst[n++] = c;
+				}
+			continue;
+		}
+		/* equivalence classes and repetitions */
+		if (s[0] == '[' && (s[1] == '=' || (s[1] && s[2] == '*')))
+			return (false);
+ literal:
+		if ((c = last = tr_char(&s)) == -1)
+			return (false);
+		if (s[0] == '-' && s[1]) {
+			++s;
+			if ((last = tr_char(&s)) == -1 || last < c)
+				return (false);
+		}
+		while (c <= last) {
+			if (n == TR_SETMAX)
+				return (false);
+			dst[n++] = c++;
+		}
+	}
+	*np = n;
+	return (true);
+}
+
+/* tr: the next, possibly escaped, character; -1 if unsupported */
+static int
+tr_char(const char **sp)
+{
+	const char *s = *sp;
+	int c = (unsigned char)*s++, i;
+
+	if (c == '\\' && *s) {
+		switch ((c = (unsigned char)*s++)) {
+		case 'a':
+			c = 7;
+			break;
+		case 'b':
+			c = '\b';
+			break;
+		case 'f':
+			c = '\f';
+			break;
+		case 'n':
+			c = '\n';
+			break;
+		case 'r':
+			c = '\r';
+			break;
+		case 't':
+			c = '\t';
+			break;
+		case 'v':
+			c = '\v';
+			break;
+		default:
+			if (c < '0' || c > '7')
+				break;
+			c -= '0';
+			for (i = 1; i < 3 && *s >= '0' && *s <= '7'; ++i)
+				c = c * 8 + (*s++ - '0');
+			if (c > 0xFF)
+				return (-1);
+			break;
+		}
+	} else if (UTFMODE && c >= 0x80)
+		/* multibyte characters: leave them to tr(1) */
+		return (-1);
+	*sp = s;
+	return (c);
+}
+
+/* tr: is the ASCII character c in class k? */
+static bool
+tr_class(int k, int c)
+{
+	bool lower = c >= 'a' && c <= 'z', upper = c >= 'A' && c <= 'Z';
+	bool digit = ksh_isdigit(c), alnum = lower || upper || digit;
+
+	switch (k) {
+	case TR_ALNUM:
+		return (alnum);
+	case TR_ALPHA:
+		return (lower || upper);
+	case TR_BLANK:
+		return (c == ' ' || c == '\t');
+	case TR_CNTRL:
+		return (c < 32 || c == 127);
+	case TR_DIGIT:
+		return (digit);
+	case TR_GRAPH:
+		return (c > 32 && c < 127);
+	case TR_LOWER:
+		return (lower);
+	case TR_PRINT:
+		return (c >= 32 && c < 127);
+	case TR_PUNCT:
+		return (c > 32 && c < 127 && !alnum);
+	case TR_SPACE:
+		return (c == ' ' || (c >= 9 && c <= 13));
+	case TR_UPPER:
+		return (upper);
+	}
+	/* TR_XDIGIT */
+	return (digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+}
+
+static int
+tu_main(int which, const char **wp)
+{
+	struct tu tu;
+	const char *fn;
+	int fd, rv = 0;
+	bool many, first = true;
+
+	if (!tu_parse(which, wp, &tu, true))
+		return (1);
+	bout_flush();
+	tu.buf = alloc(TU_BUFSIZ, ATEMP);
+	if (which == TU_TR) {
+		/* the operands are the strings */
+		rv = tu_tr(STDIN_FILENO, "<stdin>", &tu);
+		goto out;
+	}
+
+	wp = tu.wp;
+	many = wp[0] != NULL && wp[1] != NULL;
+	do {
+		fd = STDIN_FILENO;
+		fn = "<stdin>";
+		if (*wp) {
+			fn = *wp++;
+			if (!(fn[0] == '-' && fn[1] == '\0') &&
+			    (fd = open(fn, O_RDONLY | O_BINARY)) < 0) {
+				bi_errorf("%s: %s", fn, cstrerror(errno));
+				rv = 1;
+				continue;
+			}
+		}
+		if (many && which != TU_WC) {
+			shf_fprintf(shl_stdout, "%s==> %s <==\n",
+			    first ? "" : "\n", fd == STDIN_FILENO ?
+			    "standard input" : fn);
+			first = false;
+		}
+		switch (which) {
+		case TU_HEAD:
+			rv |= tu_head(fd, fn, &tu);
+			break;
+		case TU_TAIL:
+			rv |= tu_tail(fd, fn, &tu);
+			break;
+		case TU_WC:
+			rv |= tu_wc(fd, fn, &tu);
+			wc_show(tu.cnt, tu.flags, tu.wp[0] ? fn : NULL);
+			break;
+		}
+		if (fd != STDIN_FILENO)
+			close(fd);
+	} while (*wp);
+	if (which == TU_WC && many)
+		wc_show(tu.tot, tu.flags, "total");
+
+ out:
+	afree(tu.buf, ATEMP);
+	return (rv);
+}
+
+/* read(2) with ^C checks; reports errors */
+static ssize_t
+tu_read(int fd, char *buf, size_t len, const char *fn)
+{
+	ssize_t n;
+	int eno;
+
+	while (/* CONSTCOND */ 1) {
+		n = blocking_read(fd, buf, len);
+		eno = errno;
+		/* give the user a chance to ^C out */
+		intrcheck();
+		if (n != -1 || eno != EINTR)
+			break;
+	}
+	if (n == -1)
+		bi_errorf("%s: %s", fn, cstrerror(eno));
+	return (n);
+}
+
+/* write to standard output; reports errors */
+static bool
+tu_write(const char *buf, size_t len)
+{
+	if (len == 0 || shf_write(buf, (ssize_t)len, shl_stdout) != EOF)
+		return (true);
+	bi_errorf("%s: %s", "<stdout>", cstrerror(errno));
+	return (false);
+}
+
+/* copy the rest of fd to standard output */
+static int
+tu_copy(int fd, const char *fn, struct tu *tu)
+{
+	ssize_t n;
+
+	while ((n = tu_read(fd, tu->buf, TU_BUFSIZ, fn)) > 0)
+		if (!tu_write(tu->buf, n))
+			return (1);
+	return (n == -1);
+}
+
+static int
+tu_head(int fd, const char *fn, struct tu *tu)
+{
+	size_t left = tu->num;
+	ssize_t n;
+	char *cp, *ep;
+
+	while (left) {
+		n = tu_read(fd, tu->buf, (tu->flags & TU_BYTES) &&
+		    left < TU_BUFSIZ ? left : TU_BUFSIZ, fn);
+		if (n == -1)
+			return (1);
+		if (n == 0)
+			break;
+		ep = tu->buf + n;
+		if (tu->flags & TU_BYTES) {
+			cp = ep;
+			left -= n;
+		} else {
+			cp = tu->buf;
+			while (left && (cp = memchr(cp, '\n', ep - cp)) != NULL) {
+				++cp;
+				--left;
+			}
+			if (cp == NULL)
+				cp = ep;
+		}
+		if (!tu_write(tu->buf, cp - tu->buf))
+			return (1);
+		if (cp < ep)
+			/* leave the rest to the next reader, if seekable */
+			lseek(fd, (off_t)(cp - ep), SEEK_CUR);
+	}
+	return (0);
+}
+
+static int
+tu_tail(int fd, const char *fn, struct tu *tu)
+{
+	struct stat sb;
+	off_t cur, start;
+
+	if (tu->flags & TU_PLUS)
+		return (tail_plus(fd, fn, tu));
+	if (fstat(fd, &sb) || !S_ISREG(sb.st_mode) ||
+	    (cur = lseek(fd, (off_t)0, SEEK_CUR)) == (off_t)-1)
+		return (tail_buffered(fd, fn, tu));
+
+	/* regular file: find the start from its end */
+	if (cur >= sb.st_size)
+		return (0);
+	if (tu->flags & TU_BYTES)
+		start = sb.st_size - cur > (off_t)tu->num ?
+		    sb.st_size - (off_t)tu->num : cur;
+	else if ((start = tail_back(fd, fn, tu, cur, sb.st_size)) == -1)
+		return (1);
+	if (lseek(fd, start, SEEK_SET) == (off_t)-1) {
+		bi_errorf("%s: %s", fn, cstrerror(errno));
+		return (1);
+	}
+	return (tu_copy(fd, fn, tu));
+}
+
+/* tail +N: skip N - 1 lines or bytes, then copy the rest */
+static int
+tail_plus(int fd, const char *fn, struct tu *tu)
+{
+	struct stat sb;
+	size_t skip = tu->num ? tu->num - 1 : 0;
+	ssize_t n;
+	char *cp, *ep;
+
+	if (skip && (tu->flags & TU_BYTES) && !fstat(fd, &sb) &&
+	    S_ISREG(sb.st_mode) && lseek(fd, (off_t)skip, SEEK_CUR) != -1)
+		skip = 0;
+	while (skip) {
+		n = tu_read(fd, tu->buf, (tu->flags & TU_BYTES) &&
+		    skip < TU_BUFSIZ ? skip : TU_BUFSIZ, fn);
+		if (n <= 0)
+			return (n == -1);
+		ep = tu->buf + n;
+		if (tu->flags & TU_BYTES) {
+			cp = ep;
+			skip -= n;
+		} else {
+			cp = tu->buf;
+			while (skip && (cp = memchr(cp, '\n', ep - cp)) != NULL) {
+				++cp;
+				--skip;
+			}
+			if (cp == NULL)
+				cp = ep;
+		}
+		if (!tu_write(cp, ep - cp))
+			return (1);
+	}
+	return (tu_copy(fd, fn, tu));
+}
+
+/* seekable regular file: where its last tu->num lines start */
+static off_t
+tail_back(int fd, const char *fn, struct tu *tu, off_t cur, off_t end)
+{
+	size_t want = tu->num;
+	off_t pos = end;
+	ssize_t n, i;
+
+	if (want == 0)
+		return (end);
+	while (pos > cur) {
+		n = pos - cur > TU_BUFSIZ ? TU_BUFSIZ : (ssize_t)(pos - cur);
+		pos -= n;
+		if (lseek(fd, pos, SEEK_SET) == (off_t)-1) {
+			bi_errorf("%s: %s", fn, cstrerror(errno));
+			return (-1);
+		}
+		if ((n = tu_read(fd, tu->buf, n, fn)) == -1)
+			return (-1);
+		i = n;
+		/* the newline ending the last line does not count */
+		if (pos + n == end && i && tu->buf[i - 1] == '\n')
+			--i;
+		while (i--)
+			if (tu->buf[i] == '\n' && !--want)
+				return (pos + i + 1);
+	}
+	return (cur);
+}
+
+/* pipes etc.: keep only as much as may still be needed in memory */
+static int
+tail_buffered(int fd, const char *fn, struct tu *tu)
+{
+	char *b = NULL;
+	size_t len = 0, size = 0, keep = TU_BUFSIZ, ofs;
+	ssize_t n;
+	int rv = 1;
+
+	while (/* CONSTCOND */ 1) {
+		if (size - len < TU_BUFSIZ)
+			b = aresize(b, (size = (len + TU_BUFSIZ) * 2), ATEMP);
+		if ((n = tu_read(fd, b + len, TU_BUFSIZ, fn)) == -1)
+			goto out;
+		if (n == 0)
+			break;
+		len += n;
+		if (len >= keep * 2) {
+			if ((ofs = tail_start(b, len, tu)) != 0)
+				memmove(b, b + ofs, (len -= ofs));
+			keep = len > TU_BUFSIZ ? len : TU_BUFSIZ;
+		}
+	}
+	ofs = tail_start(b, len, tu);
+	if (tu_write(b + ofs, len - ofs))
+		rv = 0;
+ out:
+	afree(b, ATEMP);
+	return (rv);
+}
+
+/* offset of the last tu->num lines or bytes in b */
+static size_t
+tail_start(const char *b, size_t len, struct tu *tu)
+{
+	size_t want = tu->num, i = len;
+
+	if (tu->flags & TU_BYTES)
+		return (len > want ? len - want : 0);
+	if (want == 0)
+		return (len);
+	if (i && b[i - 1] == '\n')
+		--i;
+	while (i--)
+		if (b[i] == '\n' && !--want)
+			return (i + 1);
+	return (0);
+}
+
+static int
+tu_tr(int fd, const char *fn, struct tu *tu)
+{
+	ssize_t n;
+	unsigned char *cp, *ep, *dp;
+
+	while ((n = tu_read(fd, tu->buf, TU_BUFSIZ, fn)) > 0) {
+		cp = dp = (unsigned char *)tu->buf;
+		ep = cp + n;
+		if (tu->flags & TU_DELETE) {
+			while (cp < ep) {
+				if (!tu->del[*cp])
+					*dp++ = *cp;
+				++cp;
+			}
+			n = dp - (unsigned char *)tu->buf;
+		} else
+			while (cp < ep) {
+				*cp = tu->map[*cp];
+				++cp;
+			}
+		if (!tu_write(tu->buf, n))
+			return (1);
+	}
+	return (n == -1);
+}
+
+static int
+tu_wc(int fd, const char *fn, struct tu *tu)
+{
+	unsigned long *cnt = tu->cnt;
+	ssize_t n;
+	unsigned char *cp, *ep;
+	bool inword = false, bytewise;
+	int i;
+
+	memset(cnt, 0, sizeof(tu->cnt));
+	bytewise = (tu->flags & TU_WORDS) || ((tu->flags & TU_CHARS) &&
+	    UTFMODE);
+	while ((n = tu_read(fd, tu->buf, TU_BUFSIZ, fn)) > 0) {
+		cp = (unsigned char *)tu->buf;
+		ep = cp + n;
+		cnt[3] += n;
+		if (!bytewise) {
+			/* fast path for lines and bytes */
+			while (cp < ep)
+				cnt[0] += *cp++ == '\n';
+			continue;
+		}
+		for (; cp < ep; ++cp) {
+			if (*cp == '\n')
+				++cnt[0];
+			if (*cp == ' ' || (*cp >= 9 && *cp <= 13))
+				inword = false;
+			else if (!inword) {
+				inword = true;
+				++cnt[1];
+			}
+			/* count UTF-8 lead bytes only */
+			if ((*cp & 0xC0) != 0x80)
+				++cnt[2];
+		}
+	}
+	if (!UTFMODE || !bytewise)
+		cnt[2] = cnt[3];
+	for (i = 0; i < 4; ++i)
+		tu->tot[i] += cnt[i];
+	return (n == -1);
+}
+
+/* wc: one line of output in the POSIX format */
+static void
+wc_show(unsigned long *cnt, int flags, const char *name)
+{
+	const char *sep = "";
+	int i;
+
+	for (i = 0; i < 4; ++i)
+		if (flags & (TU_LINES << i)) {
+			shf_fprintf(shl_stdout, "%s%lu", sep, cnt[i]);
+			sep = " ";
+		}
+	if (name != NULL)
+		shf_fprintf(shl_stdout, " %s", name);
+	shf_putc('\n', shl_stdout);
+}
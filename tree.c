@@ -120,8 +120,16 @@ ptree(struct op *t, int indent, struct shf *shf)
 		break;
 	case TSELECT:
 	case TFOR:
-		fptreef(shf, indent, "%s %s ",
-		    (t->type == TFOR) ? "for" : Tselect, t->str);
+	case TPFOR:
+		shf_puts((t->type == TSELECT) ? Tselect : "for", shf);
+		if (t->type == TPFOR) {
+			fptreef(shf, indent, " -P %S", t->args[0]);
+			if (t->u.ordered)
+				shf_puts(" -o", shf);
+			if (t->args[1] != NULL)
+				fptreef(shf, indent, " -s %S", t->args[1]);
+		}
+		fptreef(shf, indent, " %s ", t->str);
 		if (t->vars != NULL) {
 			shf_puts("in ", shf);
 			w = (const char **)t->vars;
@@ -1063,6 +1071,17 @@ dumptree(struct shf *shf, struct op *t)
 		goto dumpleftandout;
 	OPEN(TSELECT)
 		goto dumpfor;
+	OPEN(TPFOR)
+		shf_fprintf(shf, " ordered<%s>", t->u.ordered ? "yes" : "no");
+		shf_puts(" max<", shf);
+		dumpwdvar(shf, t->args[0]);
+		shf_putc('>', shf);
+		if (t->args[1] != NULL) {
+			shf_puts(" status<", shf);
+			dumpwdvar(shf, t->args[1]);
+			shf_putc('>', shf);
+		}
+		goto dumpfor;
 	OPEN(TCASE)
 		shf_fprintf(shf, " str<%s>", t->str);
 		i = 0;
@@ -378,6 +378,15 @@ str_val(struct tbl *vp)
 			s[2 + sz] = '\0';
 		} else {
 			*--s = '\0';
+			if (base == 10)
+				/* two digits at a time */
+				while (n >= 100) {
+					unsigned int i = (n % 100) << 1;
+
+					n /= 100;
+					*--s = digits_dec2[i + 1];
+					*--s = digits_dec2[i];
+				}
 			do {
 				*--s = digits[n % base];
 				n /= base;
@@ -1081,6 +1090,31 @@ special(const char *name)
 	return (tp && (tp->flag & ISSET) ? tp->type : V_NONE);
 }
 
+/*
+ * Whether the parameter name, as in ${name...}, gives another value in
+ * a subshell or changes the state of the shell when read, that is, if
+ * it must not be expanded in place for $(...), see comsub_word()
+ */
+bool
+special_subshell(const char *name)
+{
+	char buf[8];
+	size_t n;
+
+	if (*name == '#' || *name == '!' || *name == '%')
+		++name;
+	if ((n = strcspn(name, "[")) >= sizeof(buf))
+		return (false);
+	memcpy(buf, name, n);
+	buf[n] = '\0';
+	switch (special(buf)) {
+	case V_BASHPID:
+	case V_RANDOM:
+		return (true);
+	}
+	return (false);
+}
+
 /* Make a variable non-special */
 static void
 unspecial(const char *name)
@@ -1226,11 +1260,13 @@ setspec(struct tbl *vp)
 		}
 		/* FALLTHROUGH */
 	case V_HISTSIZE:
+	case V_JOBMAX:
 	case V_LINENO:
 	case V_OPTIND:
 	case V_RANDOM:
 	case V_SECONDS:
 	case V_TMOUT:
+	case V_XTRACEFD:
 		vp->flag &= ~SPECIAL;
 		if (getint(vp, &num, false) == -1) {
 			s = str_val(vp);
@@ -1255,6 +1291,9 @@ setspec(struct tbl *vp)
 	case V_HISTSIZE:
 		sethistsize(num.i);
 		break;
+	case V_JOBMAX:
+		ksh_jobmax = num.i > 0 ? num.i : 0;
+		break;
 	case V_LINENO:
 		/* The -1 is because line numbering starts at 1. */
 		user_lineno = num.u - current_lineno - 1;
@@ -1284,6 +1323,19 @@ setspec(struct tbl *vp)
 	case V_TMOUT:
 		ksh_tmout = num.i >= 0 ? num.i : 0;
 		break;
+	case V_XTRACEFD:
+		/* only those the user can redirect */
+		if (num.i < 0 || num.i >= FDBASE)
+			errorf("%s: %s: %s", vp->name, "bad number",
+			    str_val(vp));
+		ksh_xtracefd = num.i;
+		if (Flag(FXTRACE) == 2)
+			/* traced assignment: once the line is done */
+			xtrace_newfd = true;
+		else if (Flag(FXTRACE))
+			/* take the new fd right away */
+			change_xtrace(Flag(FXTRACE), true);
+		break;
 	}
 }
 
@@ -1317,6 +1369,18 @@ unsetspec(struct tbl *vp)
 			tmpdir = NULL;
 		}
 		break;
+	case V_JOBMAX:
+		/* stays special, no limit */
+		ksh_jobmax = 0;
+		break;
+	case V_XTRACEFD:
+		/* stays special, back to standard error */
+		ksh_xtracefd = 2;
+		if (Flag(FXTRACE) == 2)
+			xtrace_newfd = true;
+		else if (Flag(FXTRACE))
+			change_xtrace(Flag(FXTRACE), true);
+		break;
 	case V_LINENO:
 	case V_RANDOM:
 	case V_SECONDS:
@@ -27,6 +27,7 @@ FN(HISTFILE)
 #endif
 FN(HISTSIZE)
 FN(IFS)
+FN(JOBMAX)
 FN(LINENO)
 FN(LINES)
 FN(OPTIND)
@@ -35,6 +36,7 @@ FN(RANDOM)
 FN(SECONDS)
 FN(TMOUT)
 FN(TMPDIR)
+FN(XTRACEFD)
 
 #undef FN
 #undef F0